@@ -23,7 +23,8 @@ MEMORY
 	PRU_DMEM_1_0	: org = 0x00002000 len = 0x00002000	CREGISTER=25 /* 8kB PRU Data RAM 1_0 */
 
 	PAGE 2:
-	PRU_SHAREDMEM	: org = 0x00010000 len = 0x00003000 CREGISTER=28 /* 12kB Shared RAM */
+	PRU_SHAREDMEM	: org = 0x00010000 len = 0x00002800 CREGISTER=28 /* 10kB Shared RAM, display buffer */
+	PRU_SHAREDCTRL	: org = 0x00012800 len = 0x00000800	/* 2kB Shared RAM, host control block */
 
 	DDR			    : org = 0x80000000 len = 0x00000100	CREGISTER=31
 	L3OCMC			: org = 0x40000000 len = 0x00010000	CREGISTER=30
@@ -85,4 +86,5 @@ SECTIONS {
 	.other_dram	>  PRU_DMEM_1_0, PAGE 1
 	.resource_table > PRU_DMEM_0_1, PAGE 1
 	.share_buff > PRU_SHAREDMEM, PAGE 2
+	.share_ctrl > PRU_SHAREDCTRL, PAGE 2
 }
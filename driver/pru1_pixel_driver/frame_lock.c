@@ -0,0 +1,65 @@
+/*
+ * frame_lock.c
+ *
+ * see frame_lock.h
+ */
+
+#include "frame_lock.h"
+
+static int32_t clamp(int32_t v, int32_t limit)
+{
+	if (v > limit)
+		return limit;
+	if (v < -limit)
+		return -limit;
+	return v;
+}
+
+void frame_lock_reset(struct frame_lock *fl, int32_t limit)
+{
+	fl->integ = 0;
+	fl->limit = limit;
+	fl->phase_err = 0;
+	fl->correction = 0;
+	fl->good = 0;
+	fl->missed = 0;
+}
+
+int32_t frame_lock_update(struct frame_lock *fl, uint32_t phase,
+			  uint32_t period)
+{
+	int32_t err;
+
+	// edge in the first half: the master started after us, we're early
+	if (phase < period / 2)
+		err = (int32_t) phase;
+	else
+		err = (int32_t) phase - (int32_t) period;
+
+	fl->phase_err = err;
+	fl->missed = 0;
+
+	if (err < FRAME_LOCK_WINDOW && err > -FRAME_LOCK_WINDOW) {
+		if (fl->good < FRAME_LOCK_FRAMES)
+			fl->good++;
+	} else {
+		fl->good = 0;
+	}
+
+	// integrator is clamped too, or it winds up while we slew
+	fl->integ = clamp(fl->integ + err, fl->limit << FRAME_LOCK_KI_SHIFT);
+	fl->correction = clamp((err >> FRAME_LOCK_KP_SHIFT) +
+			       (fl->integ >> FRAME_LOCK_KI_SHIFT), fl->limit);
+	return fl->correction;
+}
+
+int32_t frame_lock_hold(struct frame_lock *fl)
+{
+	if (fl->missed < 0xFFFF)
+		fl->missed++;
+	// near lock the edge straddles the boundary, so a frame can miss it
+	if (fl->missed > 1)
+		fl->good = 0;
+	fl->correction = clamp(fl->integ >> FRAME_LOCK_KI_SHIFT, fl->limit);
+	return fl->correction;
+}
@@ -0,0 +1,54 @@
+/*
+ * frame_lock.h
+ *
+ * phase lock of the frame rate to an external sync pulse, so walls
+ * driven by different BeagleBones don't drift against each other.
+ *
+ * once per frame the firmware hands over the phase of the sync edge
+ * (PRU cycles since our own frame start) and gets back a correction
+ * of the frame period, which it spreads over the DIM intervals of the
+ * timing table.  a PI loop, so a constant crystal offset ends up in
+ * the integrator and the residual phase error goes to ~zero.
+ *
+ * plain C so the host simulation (host/framelock_sim.c) runs the same
+ * code as the firmware.
+ */
+
+#ifndef FRAME_LOCK_H
+#define FRAME_LOCK_H
+
+#include <stdint.h>
+
+/* lock modes, written by the host in shared_ctrl.lock_mode */
+#define LOCK_FREE	0	/* free run, ignore the sync input */
+#define LOCK_SLAVE	1	/* follow the sync input */
+#define LOCK_MASTER	2	/* drive the sync output */
+
+#define FRAME_LOCK_KP_SHIFT	2	/* Kp = 1/4  */
+#define FRAME_LOCK_KI_SHIFT	5	/* Ki = 1/32 */
+
+/* phase error that counts as locked, and for how many frames */
+#define FRAME_LOCK_WINDOW	4000	/* cycles, 20 us */
+#define FRAME_LOCK_FRAMES	16
+
+struct frame_lock {
+	int32_t integ;		/* integrated phase error */
+	int32_t limit;		/* largest correction the timing table takes */
+	int32_t phase_err;	/* last phase error, + means we are early */
+	int32_t correction;	/* frame period correction, cycles */
+	uint16_t good;		/* frames in a row inside the window */
+	uint16_t missed;	/* frames in a row without a sync edge */
+};
+
+#define frame_lock_locked(fl)	((fl)->good >= FRAME_LOCK_FRAMES)
+
+void frame_lock_reset(struct frame_lock *fl, int32_t limit);
+
+/* sync edge seen phase cycles into a frame of period cycles */
+int32_t frame_lock_update(struct frame_lock *fl, uint32_t phase,
+			  uint32_t period);
+
+/* no sync edge this frame, coast on the integrator */
+int32_t frame_lock_hold(struct frame_lock *fl);
+
+#endif /* FRAME_LOCK_H */
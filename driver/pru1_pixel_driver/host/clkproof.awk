@@ -0,0 +1,112 @@
+# clkproof.awk
+#
+# cycle count proof of the shift kernels, from the dispru listing:
+#
+#   awk -f host/clkproof.awk gen/pru1_pixel_driver.asm
+#
+# for every shift_NN symbol, find its hardware LOOP and walk the body
+# twice, counting 1 cycle an instruction and 3 (+1 a word past the
+# first) for a load from shared RAM.  the CLK edges are the writes to
+# R30: OR R30, ... (data out, CLK low) and SET R30, R30, CLK.  prints
+# the low and high time of every kernel and fails if any edge is off.
+
+BEGIN {
+	if (clk == "")
+		clk = 6
+	n = 0
+	bad = 0
+}
+
+function hex(s,    i, v) {
+	s = tolower(s)
+	sub(/^0x/, "", s)
+	v = 0
+	for (i = 1; i <= length(s); i++)
+		v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+	return v
+}
+
+function cycles(text,    f, nf, bytes) {
+	if (text !~ /^(LBBO|LBCO)/)
+		return 1
+	nf = split(text, f, /, */)
+	bytes = f[nf] + 0
+	return 3 + int((bytes - 1) / 4)
+}
+
+# label lines are "addr  name:", instructions "addr  opcode  text"
+$1 ~ /^[0-9a-fA-F]+$/ && NF == 2 && $2 ~ /:$/ {
+	name = substr($2, 1, length($2) - 1)
+	label[name] = hex($1)
+	next
+}
+
+$1 ~ /^[0-9a-fA-F]+$/ && $2 ~ /^[0-9a-fA-F]+$/ && NF > 2 {
+	text = $0
+	sub(/^[ \t]*[0-9a-fA-F]+[ \t]+[0-9a-fA-F]+[ \t]+/, "", text)
+	sub(/[ \t]+$/, "", text)
+	n++
+	addr[n] = hex($1)
+	inst[n] = text
+}
+
+function prove(name,    i, start, end, target, f, t, it, nr, nf,
+	       rise, fall, lo, hi, ok) {
+	for (i = 1; i <= n && addr[i] != label[name]; i++)
+		;
+	for (; i <= n && inst[i] !~ /^LOOP /; i++)
+		;
+	if (i > n) {
+		printf "%-10s no LOOP found\n", name
+		return 0
+	}
+	start = i + 1
+	split(substr(inst[i], 6), f, /, */)
+	target = (f[1] ~ /^0x/) ? hex(f[1]) : label[f[1]]
+	for (end = start; end <= n && addr[end] != target; end++)
+		;
+
+	t = 0
+	nr = 0
+	nf = 0
+	for (it = 0; it < 2; it++) {
+		for (i = start; i < end; i++) {
+			if (inst[i] ~ /^(QB|JMP|JAL)/) {
+				printf "%-10s branch in the loop body\n", name
+				return 0
+			}
+			if (inst[i] ~ /^OR R30,/ || inst[i] == "CLR R30, R30, " clk)
+				fall[++nf] = t
+			if (inst[i] == "SET R30, R30, " clk)
+				rise[++nr] = t
+			t += cycles(inst[i])
+		}
+	}
+
+	ok = (nr == nf && nr >= 2)
+	lo = rise[1] - fall[1]
+	hi = fall[2] - rise[1]
+	for (i = 1; ok && i < nr; i++)
+		if (rise[i] - fall[i] != lo || fall[i + 1] - rise[i] != hi)
+			ok = 0
+	printf "%-10s lo %d  hi %d  %2d cycles  %4.1f MHz  %d clocks/iteration  %s\n",
+	       name, lo, hi, lo + hi, 200 / (lo + hi), nr / 2,
+	       ok ? "even" : "UNEVEN"
+	return ok
+}
+
+END {
+	found = 0
+	for (name in label) {
+		if (name !~ /^shift_[0-9]+$/)
+			continue
+		found++
+		if (!prove(name))
+			bad++
+	}
+	if (!found) {
+		print "no shift_NN kernels in the listing"
+		exit 1
+	}
+	exit bad != 0
+}
@@ -0,0 +1,321 @@
+/*
+ * encode_check.c
+ *
+ * golden output and speed of the frame encoder (load_test_pattern() in
+ * test_pattern.c), for one build configuration.  make check and make
+ * bench build and run it for every panel_wiring.h profile and chain
+ * length, see ENCODE_CONFIGS in the Makefile.
+ *
+ *   encode_check -c config [-g golden] [-u] [-w dir] [-b msec]
+ *
+ * -c  name of the configuration, the first column of the golden file
+ * -g  golden file (encode_golden.txt), a line per config and pattern:
+ *     "config pattern bytes fnv64" of the planes and the frame info
+ * -u  write this config's lines of the golden file instead of checking
+ * -w  write every encoded frame to dir/config-pattern.bin, to cmp
+ *     against the output of another build
+ * -b  time every backend for msec per pattern, ns/pixel and MB/s of
+ *     encoded planes.  this is host time, the PRU is many times slower,
+ *     compare runs on the same machine only.
+ *
+ * the patterns are the images built into test_pattern.c when the frame
+ * is their size, and synthetic ones at any size.  exits 1 on a mismatch
+ * or a pattern without a golden.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "panel_wiring.h"
+#include "shared_ctrl.h"
+
+#if !defined(W_FB) || !defined(H_FB)
+#error "build with -DW_FB=.. -DH_FB=.., as the Makefile does"
+#endif
+
+#define SCANLEN		(W_FB * H_FB / (N_LINES * 2))
+#define FRAME_BYTES	(N_LINES * N_BITS * SCANLEN)
+#define PIXELS		(W_FB * H_FB)
+
+#define MAX_PATTERNS	16
+#define MAX_LINES	256
+
+/* test_pattern.c */
+uint16_t load_test_pattern(volatile uint8_t *buffer);
+void test_pattern_use(const uint16_t *image);
+const uint16_t *test_pattern_asset(unsigned int i, const char **name);
+void frame_timing(volatile struct frame_info *info, uint32_t color_min,
+		  uint32_t plane_overhead);
+void scan_plane_flags(const uint8_t *buffer, uint16_t scanlen,
+		      volatile uint8_t *flags);
+
+/* an encoder, image in, planes out, returns the scanline length */
+struct backend {
+	const char *name;
+	uint16_t (*encode)(const uint16_t *image, uint8_t *buffer);
+};
+
+static uint16_t encode_c(const uint16_t *image, uint8_t *buffer)
+{
+	test_pattern_use(image);
+	return load_test_pattern(buffer);
+}
+
+static const struct backend backends[] = {
+	{ "c", encode_c },
+};
+#define N_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+struct pattern {
+	char name[32];
+	const uint16_t *image;
+};
+
+static struct pattern patterns[MAX_PATTERNS];
+static unsigned int n_patterns;
+
+static uint16_t rgb565(unsigned int r, unsigned int g, unsigned int b)
+{
+	return (r & 0x1F) << 11 | (g & 0x3F) << 5 | (b & 0x1F);
+}
+
+static void add(const char *name, const uint16_t *image)
+{
+	struct pattern *p = &patterns[n_patterns++];
+
+	snprintf(p->name, sizeof(p->name), "%s", name);
+	p->image = image;
+}
+
+/*
+	synthetic patterns. coords gives every pixel of a panel its own
+	colour, so any mapping slip changes the output, the others cover
+	black, full scale, every level of each channel and noise.
+*/
+static void add_synthetic(void)
+{
+	static uint16_t img[5][PIXELS];
+	uint32_t seed = 1;
+	unsigned int x, y, i;
+
+	for (y = 0; y < H_FB; y++) {
+		for (x = 0; x < W_FB; x++) {
+			i = y * W_FB + x;
+			img[0][i] = 0;
+			img[1][i] = 0xFFFF;
+			img[2][i] = rgb565(x, y, x / 32 + (y / 16) * 8);
+			img[3][i] = rgb565(x, 2 * y, 31 - x);
+			seed = seed * 1103515245 + 12345;
+			img[4][i] = seed >> 16;
+		}
+	}
+	add("black", img[0]);
+	add("white", img[1]);
+	add("coords", img[2]);
+	add("ramp", img[3]);
+	add("noise", img[4]);
+}
+
+static uint64_t fnv64(uint64_t h, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	while (len--)
+		h = (h ^ *p++) * 0x100000001B3ULL;
+	return h;
+}
+
+/* the planes as encoded, and the info the firmware would publish */
+static uint64_t encode_hash(const struct backend *be, const uint16_t *image,
+			    uint8_t *buffer)
+{
+	static struct frame_info info;
+	uint16_t scanlen;
+
+	memset(buffer, 0, FRAME_BYTES);
+	memset(&info, 0, sizeof(info));
+	scanlen = be->encode(image, buffer);
+	if (scanlen != SCANLEN) {
+		fprintf(stderr, "%s: scanline %u, expected %u\n", be->name,
+			scanlen, SCANLEN);
+		exit(1);
+	}
+	scan_plane_flags(buffer, scanlen, info.plane_flags);
+	frame_timing(&info, 100, 0);
+	return fnv64(fnv64(0xCBF29CE484222325ULL, buffer, FRAME_BYTES),
+		     &info, sizeof(info));
+}
+
+static char golden[MAX_LINES][96];
+static unsigned int n_golden;
+
+static void golden_read(const char *path)
+{
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+		return;		// none yet
+	while (n_golden < MAX_LINES &&
+	       fgets(golden[n_golden], sizeof(golden[0]), f))
+		n_golden++;
+	fclose(f);
+}
+
+static const char *golden_find(const char *config, const char *pattern)
+{
+	char key[80];
+	size_t len = snprintf(key, sizeof(key), "%s %s ", config, pattern);
+	unsigned int i;
+
+	for (i = 0; i < n_golden; i++)
+		if (!strncmp(golden[i], key, len))
+			return golden[i] + len;
+	return NULL;
+}
+
+/* every other config's lines as they were, then ours, sorted by make */
+static int golden_write(const char *path, const char *config,
+			const uint64_t *hash)
+{
+	size_t len = strlen(config);
+	unsigned int i;
+	FILE *f = fopen(path, "w");
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	for (i = 0; i < n_golden; i++)
+		if (strncmp(golden[i], config, len) || golden[i][len] != ' ')
+			fputs(golden[i], f);
+	for (i = 0; i < n_patterns; i++)
+		fprintf(f, "%s %s %u %016llx\n", config, patterns[i].name,
+			FRAME_BYTES, (unsigned long long) hash[i]);
+	return fclose(f);
+}
+
+static double host_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(const char *config, uint8_t *buffer, unsigned long msec)
+{
+	unsigned int b, i;
+
+	for (b = 0; b < N_BACKENDS; b++) {
+		double t = 0, t0;
+		unsigned long n = 0;
+
+		for (i = 0; i < n_patterns; i++) {
+			double until = host_secs() + msec * 1e-3;
+
+			t0 = host_secs();
+			do {
+				backends[b].encode(patterns[i].image, buffer);
+				n++;
+			} while (host_secs() < until);
+			t += host_secs() - t0;
+		}
+		printf("%-14s %-4s %8.2f ns/pixel %8.1f MB/s\n", config,
+		       backends[b].name, t * 1e9 / ((double) n * PIXELS),
+		       (double) n * FRAME_BYTES / t / 1e6);
+	}
+}
+
+static int write_frame(const char *dir, const char *config,
+		       const char *pattern, const uint8_t *buffer)
+{
+	char path[1024];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s-%s.bin", dir, config, pattern);
+	f = fopen(path, "wb");
+	if (!f || fwrite(buffer, FRAME_BYTES, 1, f) != 1) {
+		perror(path);
+		return -1;
+	}
+	return fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	const char *config = NULL, *path = "encode_golden.txt", *dir = NULL;
+	static uint8_t buffer[FRAME_BYTES];
+	uint64_t hash[MAX_PATTERNS];
+	unsigned long msec = 0;
+	const uint16_t *image;
+	const char *name, *want;
+	char got[40];
+	int opt, update = 0, failed = 0;
+	unsigned int i, b;
+
+	while ((opt = getopt(argc, argv, "c:g:uw:b:")) != -1) {
+		switch (opt) {
+		case 'c': config = optarg; break;
+		case 'g': path = optarg; break;
+		case 'u': update = 1; break;
+		case 'w': dir = optarg; break;
+		case 'b': msec = strtoul(optarg, NULL, 0); break;
+		default:
+			config = NULL;
+			optind = argc;
+			break;
+		}
+	}
+	if (!config) {
+		fprintf(stderr, "usage: %s -c config [-g golden] [-u] [-w dir]"
+			" [-b msec]\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 0; (image = test_pattern_asset(i, &name)); i++)
+		add(name, image);
+	add_synthetic();
+
+	if (msec) {
+		bench(config, buffer, msec);
+		return 0;
+	}
+
+	golden_read(path);
+	for (i = 0; i < n_patterns; i++) {
+		hash[i] = encode_hash(&backends[0], patterns[i].image, buffer);
+		if (dir && write_frame(dir, config, patterns[i].name, buffer))
+			return 1;
+		// every backend has to give the same bytes
+		for (b = 1; b < N_BACKENDS; b++)
+			if (encode_hash(&backends[b], patterns[i].image,
+					buffer) != hash[i]) {
+				printf("FAIL %s %s: backend %s differs\n",
+				       config, patterns[i].name,
+				       backends[b].name);
+				failed = 1;
+			}
+		if (update)
+			continue;
+
+		snprintf(got, sizeof(got), "%u %016llx\n", FRAME_BYTES,
+			 (unsigned long long) hash[i]);
+		want = golden_find(config, patterns[i].name);
+		if (!want) {
+			printf("FAIL %s %s: no golden, -u to add it\n",
+			       config, patterns[i].name);
+			failed = 1;
+		} else if (strcmp(want, got)) {
+			printf("FAIL %s %s: %s", config, patterns[i].name, got);
+			failed = 1;
+		}
+	}
+	if (update)
+		return golden_write(path, config, hash) ? 1 : 0;
+	if (!failed)
+		printf("ok   %s, %u patterns\n", config, n_patterns);
+	return failed;
+}
@@ -0,0 +1,196 @@
+/*
+ * framelock_sim.c
+ *
+ * two instance simulation of the frame lock: a master wall free runs
+ * and drives the sync pulse, a slave wall with a different crystal runs
+ * the same frame_lock.c as the firmware and trims its DIM intervals.
+ *
+ *   framelock_sim [-m master ppm] [-s slave ppm] [-p initial phase]
+ *                 [-b shift cycles] [-u lsb] [-n frames] [-v]
+ *
+ * the frame is built the way main_loop() runs it: per plane a busy
+ * shift + latch, then idle DIM and on-time waits.  the slave only sees
+ * the sync edge while it is idle, so an edge that arrives during a
+ * shift is seen when the shift ends.  all times are PRU cycles (5 ns).
+ *
+ * the on-times are binary on the LSB the firmware calibrates to for
+ * that shift (lsb_pick()), or the one given with -u, as hub75_clock -l
+ * would set it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "frame_lock.h"
+#include "panel_wiring.h"
+#include "pru1_pixel_driver.h"
+#include "refresh_plan.h"
+
+#define PLANES		(N_LINES * N_BITS)
+#define LOCK_LIMIT	((DIM_DELAY / 2) * PLANES)
+
+struct wall {
+	double ppm;		/* crystal error */
+	double start;		/* start of the current frame, ideal cycles */
+	double length;		/* length of the current frame, ideal cycles */
+};
+
+static double shift = 256 * 8 + 130;	/* 64x64 buffer at 25 MHz + latch */
+static unsigned long lsb;		/* on-time of bit 0 */
+
+/* ideal time to run n cycles of this wall's clock, and back */
+static double wall_time(const struct wall *w, double n)
+{
+	return n / (1.0 + w->ppm * 1e-6);
+}
+
+static double wall_cycles(const struct wall *w, double t)
+{
+	return t * (1.0 + w->ppm * 1e-6);
+}
+
+/* as lsb_pick() in pru1_pixel_driver.c, without a host request */
+static unsigned long lsb_fit(void)
+{
+	unsigned long overhead = shift + DIM_DELAY + PLAN_PLANE_FIXED;
+	unsigned long dead = N_BITS * overhead, most = 0;
+	unsigned long budget = PLAN_PRU_HZ / (REFRESH_MIN * N_LINES);
+	unsigned long fit = PLAN_LSB_FIT(N_BITS, overhead);
+
+	if (budget > dead)
+		most = (budget - dead) / PLAN_BINARY_SUM(N_BITS, 1);
+	return fit > most ? most : fit;
+}
+
+static double frame_period(int dim)
+{
+	return PLANES * (shift + dim) +
+	       N_LINES * PLAN_BINARY_SUM(N_BITS, lsb);
+}
+
+/*
+ * phase (slave cycles) at which the firmware notices an edge arriving
+ * at phase.  the frame opens in the previous MSB on-time, then every
+ * plane is [shift][DIM][on-time].
+ */
+static double noticed(double phase, int dim)
+{
+	double t = lsb << (N_BITS - 1);
+	int line, bit;
+
+	for (line = 0; line < N_LINES; line++) {
+		for (bit = 0; bit < N_BITS; bit++) {
+			if (phase < t)
+				return phase;
+			if (phase < t + shift)
+				return t + shift;
+			t += shift + dim;
+			if (line != N_LINES - 1 || bit != N_BITS - 1)
+				t += lsb << bit;
+		}
+	}
+	return phase;
+}
+
+int main(int argc, char **argv)
+{
+	double phase0 = 0.37;
+	long frames = 2000, f, lock_frame = -1, after = 0;
+	double err_max = 0, err_sq = 0;
+	struct wall master = { 0 }, slave = { 0 };
+	struct frame_lock fl;
+	double period;
+	int verbose = 0, dim = DIM_DELAY, opt;
+
+	slave.ppm = 50;
+
+	while ((opt = getopt(argc, argv, "m:s:p:b:u:n:v")) != -1) {
+		switch (opt) {
+		case 'm': master.ppm = atof(optarg); break;
+		case 's': slave.ppm = atof(optarg); break;
+		case 'p': phase0 = atof(optarg); break;
+		case 'b': shift = atof(optarg); break;
+		case 'u': lsb = strtoul(optarg, NULL, 0); break;
+		case 'n': frames = atol(optarg); break;
+		case 'v': verbose = 1; break;
+		default:
+			fprintf(stderr, "usage: %s [-m ppm] [-s ppm]"
+				" [-p phase 0..1] [-b shift] [-u lsb]"
+				" [-n frames] [-v]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (!lsb)
+		lsb = lsb_fit();
+	if (lsb < PLAN_LSB_MIN)
+		lsb = PLAN_LSB_MIN;
+
+	frame_lock_reset(&fl, LOCK_LIMIT);
+	period = frame_period(DIM_DELAY);
+
+	master.length = wall_time(&master, period);
+	slave.start = phase0 * period;
+	slave.length = wall_time(&slave, period);
+
+	if (verbose)
+		printf("# frame phase_us corr_cycles locked\n");
+
+	for (f = 0; f < frames; f++) {
+		double end = slave.start + slave.length;
+		double edge, phase;
+		int32_t corr;
+		double err_us;
+
+		/* first master edge inside this slave frame */
+		while (master.start + master.length <= slave.start)
+			master.start += master.length;
+		edge = master.start;
+		if (edge < slave.start)
+			edge += master.length;
+		phase = noticed(wall_cycles(&slave, edge - slave.start), dim);
+
+		/* the firmware runs the loop at the next frame boundary */
+		if (edge < end)
+			corr = frame_lock_update(&fl, (uint32_t) phase,
+						 (uint32_t) frame_period(dim));
+		else
+			corr = frame_lock_hold(&fl);
+
+		err_us = fl.phase_err / 200.0;
+		if (frame_lock_locked(&fl)) {
+			if (lock_frame < 0)
+				lock_frame = f;
+			after++;
+			err_sq += err_us * err_us;
+			if (fabs(err_us) > err_max)
+				err_max = fabs(err_us);
+		}
+		if (verbose)
+			printf("%ld %.3f %d %d\n", f, err_us, corr,
+			       frame_lock_locked(&fl));
+
+		/* quantized the same way as CT_IEP.TMR_CMP5 */
+		dim = (int) DIM_DELAY + corr / PLANES;
+		slave.start = end;
+		slave.length = wall_time(&slave, frame_period(dim));
+	}
+
+	printf("frame period %.0f cycles (%.1f Hz), LSB %lu cycles,"
+	       " crystals %+.1f / %+.1f ppm\n",
+	       period, 200e6 / period, lsb, master.ppm, slave.ppm);
+	printf("free running, the seams drift %.1f us per second\n",
+	       fabs(master.ppm - slave.ppm));
+	if (lock_frame < 0) {
+		printf("no lock after %ld frames\n", frames);
+		return 1;
+	}
+	printf("locked after %ld frames (%.1f ms)\n", lock_frame,
+	       lock_frame * period / 200e3);
+	printf("residual phase error rms %.3f us, max %.3f us over %ld frames\n",
+	       sqrt(err_sq / after), err_max, after);
+	return 0;
+}
@@ -0,0 +1,511 @@
+/*
+ * light_sim.c
+ *
+ * what the panel shows, from the host build of the firmware (see
+ * pru_host.h): the light each LED gives off, integrated over one or
+ * more frames and compared with the image the encoder was given.
+ *
+ *   light_sim [-n frames] [-k khz] [-F frame [-i image]]
+ *             [-o image.png|image.rgb] [-v]
+ *
+ * -n  frames to integrate (default 4), enough to see a pattern that
+ *     repeats over several frames, e.g. temporal dithering
+ * -F  show an encoded frame file (as hub75_queue takes it, the planes
+ *     and optionally the frame info) instead of the test pattern.  it
+ *     is queued after the first frame the way the host queues one.
+ * -i  the image the -F frame was encoded from, raw RGB565 in host
+ *     order, W_FB x H_FB.  without it only refresh and flicker are
+ *     reported.
+ * -o  the perceived image, linear, full scale at the top level.  PNG
+ *     (8 bit RGB, uncompressed) if the name ends in .png, else raw RGB
+ * -v  the mean perceived level for every source level
+ *
+ * the driver ICs are modelled from the R30 trace: CLK shifts the data
+ * in, LAT copies it to the outputs, and while OE is low the outputs of
+ * the addressed line are lit.  byte i of the latched plane is mapped
+ * back to its pixels the way encode_planes() in test_pattern.c lays
+ * them out.  a level is measured in LSB on-times per frame (the one
+ * the firmware calibrated, ctrl.lsb_cycles), so level L should come out
+ * as L.
+ *
+ * metrics:
+ *   gain       least squares perceived / source level, 1 is exact
+ *   linearity  worst mean of a level off gain * level, % of full scale
+ *   error      RMS and worst perceived - source, in levels, and PSNR
+ *   flicker    per LED the frame pattern repeats every P frames, so it
+ *              flickers at refresh / P; the lowest is printed
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* pru_mem.h before pru_host.h, which turns ctrl into a macro */
+#include "pru_mem.h"
+#include "pru_host.h"
+#include "panel_wiring.h"
+#include "pru1_pixel_driver.h"
+
+#define SCANLEN		(W_FB * H_FB / (N_LINES * 2))
+#define N_LEVELS	(1U << N_BITS)
+#define LEVEL_MASK	(N_LEVELS - 1)
+
+/* the pins as R30 masks */
+#define R30_DATA	HUB75_DATA
+#define R30_CLK		(1UL << HUB75_CLK)
+#define R30_LAT		(1UL << HUB75_LAT)
+#define R30_OE		(1UL << HUB75_OE)
+#define R30_LINE(r30)	(((r30) >> HUB75_A) & 7)
+
+#define MAX_FRAMES	64
+#define MAX_SETTLE	64	/* frames the timing may take to settle */
+#define DDR_PHYS	0x90000000UL	/* where the -F frame seems to be */
+
+const uint16_t *test_pattern_image(void);
+
+/* where byte i of a scanline goes: column, and the rows (/ N_LINES) */
+static struct {
+	uint8_t x, row_u, row_l;
+} pixel_of[SCANLEN];
+
+/* the data bit of each LED, upper then lower half, R G B */
+static const uint8_t led_val[6] = {
+	R1_VAL, G1_VAL, B1_VAL, R2_VAL, G2_VAL, B2_VAL
+};
+
+/* the driver ICs */
+static uint8_t shift_reg[SCANLEN], latched[SCANLEN];
+static uint32_t shifted;
+static uint32_t last;
+static uint64_t lit_since;
+
+/* light, in cycles: this frame, and every frame recorded */
+static uint64_t now_light[H_FB][W_FB][3];
+static uint32_t light[MAX_FRAMES][H_FB][W_FB][3];
+static uint32_t frames, frames_want = 4;
+static uint32_t bitclock_khz;
+static const char *frame_file;
+static uint8_t *ddr;
+static uint64_t t_first, t_last;
+
+/* walk encode_planes() once to see where each byte comes from */
+static void map_pixels(void)
+{
+	unsigned int p, np, mp, i, z = 0, N0, M0;
+
+	for (p = 0; p < (W_FB/W_PANEL)*(H_FB/H_PANEL); p++) {
+#ifdef V_LAYOUT
+		N0 = (W_FB/B_LEN)      * (p / (H_FB / H_PANEL));
+		M0 = (H_PANEL/N_LINES) * (p % (H_FB / H_PANEL));
+#else // H_LAYOUT
+		N0 = (p % (W_FB/W_PANEL)) * (W_PANEL/B_LEN);
+		M0 = (p / (W_FB/W_PANEL)) * (H_PANEL/N_LINES);
+#endif
+		for (np = 0; np < W_PANEL/B_LEN; np++) {
+			for (mp = H_PANEL/(N_LINES*2); mp --> 0; z++) {
+				for (i = 0; i < B_LEN; i++) {
+					pixel_of[z * B_LEN + i].x = (N0 + np) * B_LEN + i;
+					pixel_of[z * B_LEN + i].row_u = M0 + mp;
+					pixel_of[z * B_LEN + i].row_l =
+						M0 + mp + H_PANEL/(N_LINES*2);
+				}
+			}
+		}
+	}
+}
+
+/* the latched data was shown on line for cycles */
+static void shine(uint32_t line, uint64_t cycles)
+{
+	unsigned int i, led, y;
+	uint8_t data;
+
+	for (i = 0; i < SCANLEN; i++) {
+		data = latched[i];
+		if (!data)
+			continue;
+		for (led = 0; led < 6; led++) {
+			if (!(data & led_val[led]))
+				continue;
+			y = (led < 3 ? pixel_of[i].row_u : pixel_of[i].row_l) *
+			    N_LINES + line;
+			now_light[y][pixel_of[i].x][led % 3] += cycles;
+		}
+	}
+}
+
+/* the trace hook, every change of R30 */
+static void edge(uint64_t cycle, uint32_t r30, void *arg)
+{
+	uint32_t rise = (r30 ^ last) & r30;
+	unsigned int i;
+
+	// whatever was lit up to now, with the address and data it had
+	if (!(last & R30_OE))
+		shine(R30_LINE(last), cycle - lit_since);
+	lit_since = cycle;
+
+	// the register keeps the last SCANLEN bytes clocked in
+	if (rise & R30_CLK)
+		shift_reg[shifted++ % SCANLEN] = r30 & R30_DATA;
+	if (rise & R30_LAT)
+		for (i = 0; i < SCANLEN; i++)
+			latched[i] = shift_reg[(shifted + i) % SCANLEN];
+	last = r30;
+}
+
+/* the -F frame into the DDR stand-in and the queue, due right away */
+static void queue_frame(void)
+{
+	size_t slot_size = FRAME_SLOT_SIZE(ctrl.frame_size);
+	uint32_t slot = ctrl.q_head & FRAME_QUEUE_MASK;
+
+	ddr = malloc(slot_size);
+	if (!ddr || pru_frame_read(frame_file, ddr, ctrl.frame_size))
+		exit(1);
+	pru_host_ddr(ddr, DDR_PHYS, slot_size);
+
+	ctrl.queue[slot].addr = DDR_PHYS;
+	ctrl.queue[slot].pts = ctrl.clock;
+	ctrl.queue[slot].tag = 1;
+	ctrl.q_head++;
+}
+
+/*
+	frame boundaries, the light of the frame that ended is kept.  the
+	last plane of a frame is still lit when the next one starts, and is
+	counted in that one, so a frame is only recorded once the one before
+	it ran entirely at the pixel clock and LSB it is measured in, and
+	showed the frame being measured.  when any of them changes (the -k
+	poke, the LSB calibration, the -F frame presented), the recording
+	starts over after the next frame.
+*/
+static void frame(uint32_t frame, void *arg)
+{
+	static uint32_t khz, lsb, presented, settled;
+	unsigned int x, y, c;
+
+	if (ctrl.bitclock_now != khz || ctrl.lsb_cycles != lsb ||
+	    ctrl.qstats.presented != presented) {
+		khz = ctrl.bitclock_now;
+		lsb = ctrl.lsb_cycles;
+		presented = ctrl.qstats.presented;
+		settled = frame + 1;
+		frames = 0;
+	}
+	if (frame > settled && frames < frames_want) {
+		for (y = 0; y < H_FB; y++)
+			for (x = 0; x < W_FB; x++)
+				for (c = 0; c < 3; c++)
+					light[frames][y][x][c] = now_light[y][x][c];
+		if (++frames == frames_want)
+			pru_host_stop();
+	}
+	// ctrl_init() runs in the firmware, so poke after the first frame
+	if (frame == 1) {
+		ctrl.bitclock_khz = bitclock_khz;
+		if (frame_file)
+			queue_frame();
+	}
+	if (frame == settled)
+		t_first = pru_now;
+	t_last = pru_now;
+	memset(now_light, 0, sizeof(now_light));
+}
+
+static uint8_t source_level(uint16_t rgb, unsigned int c)
+{
+	static const uint8_t shift[3] = { 16 - N_BITS, 11 - N_BITS, 5 - N_BITS };
+
+	return (rgb >> shift[c]) & LEVEL_MASK;
+}
+
+/* mean perceived level of an LED, in LSBs per frame */
+static double perceived(unsigned int y, unsigned int x, unsigned int c)
+{
+	uint64_t sum = 0;
+	unsigned int f;
+
+	for (f = 0; f < frames; f++)
+		sum += light[f][y][x][c];
+	return (double) sum / frames / ctrl.lsb_cycles;
+}
+
+/* frames until the pattern of an LED repeats */
+static unsigned int period(unsigned int y, unsigned int x, unsigned int c)
+{
+	unsigned int p, f;
+	uint32_t a, b;
+
+	for (p = 1; p <= frames / 2; p++) {
+		for (f = 0; f + p < frames; f++) {
+			a = light[f][y][x][c];
+			b = light[f + p][y][x][c];
+			// a plane straddling the boundary moves a few cycles
+			if ((a > b ? a - b : b - a) > 2 + a / 100)
+				break;
+		}
+		if (f + p == frames)
+			return p;
+	}
+	return frames;
+}
+
+static void be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *p, size_t n)
+{
+	int k;
+
+	crc = ~crc;
+	while (n--) {
+		crc ^= *p++;
+		for (k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static void png_chunk(FILE *f, const char *type, const uint8_t *data,
+		      uint32_t len)
+{
+	uint8_t b[4];
+	uint32_t crc;
+
+	be32(b, len);
+	fwrite(b, 4, 1, f);
+	fwrite(type, 4, 1, f);
+	fwrite(data, len, 1, f);
+	crc = crc32(crc32(0, (const uint8_t *) type, 4), data, len);
+	be32(b, crc);
+	fwrite(b, 4, 1, f);
+}
+
+/* 8 bit RGB, the zlib stream in stored (uncompressed) blocks */
+static void write_png(FILE *f, const uint8_t *rgb, unsigned int w,
+		      unsigned int h)
+{
+	static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	size_t raw_len = (size_t) h * (1 + 3 * w), blocks, n, i, o = 0;
+	uint8_t ihdr[13] = { 0 }, *raw, *z;
+	uint32_t s1 = 1, s2 = 0;
+
+	raw = malloc(raw_len);
+	for (i = 0; i < h; i++) {
+		raw[i * (1 + 3 * w)] = 0;	// no filter
+		memcpy(raw + i * (1 + 3 * w) + 1, rgb + i * 3 * w, 3 * w);
+	}
+	blocks = (raw_len + 0xFFFE) / 0xFFFF;
+	z = malloc(2 + raw_len + 5 * blocks + 4);
+	z[o++] = 0x78;
+	z[o++] = 0x01;
+	for (i = 0; i < raw_len; i += n) {
+		n = raw_len - i > 0xFFFF ? 0xFFFF : raw_len - i;
+		z[o++] = (i + n == raw_len);
+		z[o++] = n;
+		z[o++] = n >> 8;
+		z[o++] = ~n;
+		z[o++] = ~n >> 8;
+		memcpy(z + o, raw + i, n);
+		o += n;
+	}
+	for (i = 0; i < raw_len; i++) {
+		s1 = (s1 + raw[i]) % 65521;
+		s2 = (s2 + s1) % 65521;
+	}
+	be32(z + o, s2 << 16 | s1);
+	o += 4;
+
+	be32(ihdr, w);
+	be32(ihdr + 4, h);
+	ihdr[8] = 8;		// bits
+	ihdr[9] = 2;		// RGB
+	fwrite(sig, 8, 1, f);
+	png_chunk(f, "IHDR", ihdr, 13);
+	png_chunk(f, "IDAT", z, o);
+	png_chunk(f, "IEND", NULL, 0);
+	free(raw);
+	free(z);
+}
+
+static int write_image(const char *name)
+{
+	static uint8_t rgb[H_FB][W_FB][3];
+	size_t len = strlen(name);
+	unsigned int x, y, c;
+	double v;
+	FILE *f;
+
+	for (y = 0; y < H_FB; y++)
+		for (x = 0; x < W_FB; x++)
+			for (c = 0; c < 3; c++) {
+				v = perceived(y, x, c) * 255 / LEVEL_MASK + 0.5;
+				rgb[y][x][c] = v > 255 ? 255 : v;
+			}
+
+	f = fopen(name, "wb");
+	if (!f) {
+		perror(name);
+		return -1;
+	}
+	if (len > 4 && !strcmp(name + len - 4, ".png"))
+		write_png(f, &rgb[0][0][0], W_FB, H_FB);
+	else
+		fwrite(rgb, sizeof(rgb), 1, f);
+	fclose(f);
+	return 0;
+}
+
+/* the source, RGB565 as the encoder takes it */
+static uint16_t *read_image(const char *name)
+{
+	static uint16_t src[H_FB * W_FB];
+	FILE *f = fopen(name, "rb");
+	size_t n;
+
+	if (!f) {
+		perror(name);
+		return NULL;
+	}
+	n = fread(src, sizeof(src[0]), H_FB * W_FB + 1, f);
+	fclose(f);
+	if (n != H_FB * W_FB) {
+		fprintf(stderr, "%s: expected %zu bytes\n", name, sizeof(src));
+		return NULL;
+	}
+	return src;
+}
+
+/* how far the light is off the source levels */
+static void report_error(const uint16_t *src, int verbose)
+{
+	double sum_lp = 0, sum_ll = 0, sum_e2 = 0, err_max = 0;
+	double level_sum[N_LEVELS] = { 0 }, gain, e, lin_max = 0, rms;
+	uint32_t level_n[N_LEVELS] = { 0 }, n = 0;
+	unsigned int x, y, c, l;
+	double v;
+
+	for (y = 0; y < H_FB; y++)
+		for (x = 0; x < W_FB; x++)
+			for (c = 0; c < 3; c++) {
+				l = source_level(src[y * W_FB + x], c);
+				v = perceived(y, x, c);
+				sum_lp += l * v;
+				sum_ll += l * l;
+				level_sum[l] += v;
+				level_n[l]++;
+			}
+	gain = sum_ll ? sum_lp / sum_ll : 0;
+
+	for (y = 0; y < H_FB; y++)
+		for (x = 0; x < W_FB; x++)
+			for (c = 0; c < 3; c++) {
+				l = source_level(src[y * W_FB + x], c);
+				e = perceived(y, x, c) - l;
+				sum_e2 += e * e;
+				if (fabs(e) > err_max)
+					err_max = fabs(e);
+				n++;
+			}
+	rms = sqrt(sum_e2 / n);
+
+	if (verbose)
+		printf("level   LEDs  perceived\n");
+	for (l = 0; l < N_LEVELS; l++) {
+		if (!level_n[l])
+			continue;
+		v = level_sum[l] / level_n[l];
+		e = fabs(v - gain * l) * 100 / LEVEL_MASK;
+		if (e > lin_max)
+			lin_max = e;
+		if (verbose)
+			printf("%5u %6u %10.3f\n", l, level_n[l], v);
+	}
+
+	printf("gain      %.4f\n", gain);
+	printf("linearity %.2f %% of full scale worst\n", lin_max);
+	printf("error     RMS %.3f  worst %.3f levels  PSNR %.1f dB\n", rms,
+	       err_max, rms > 0 ? 20 * log10(LEVEL_MASK / rms) : INFINITY);
+}
+
+static void report(const uint16_t *src, int verbose)
+{
+	double refresh = frames * (double) PRU_HZ / (t_last - t_first);
+	unsigned int x, y, c, p, p_max = 1;
+	uint32_t slow = 0;
+
+	printf("frames    %u  refresh %.1f Hz\n", frames, refresh);
+	if (src)
+		report_error(src, verbose);
+
+	for (y = 0; y < H_FB; y++)
+		for (x = 0; x < W_FB; x++)
+			for (c = 0; c < 3; c++) {
+				if (!perceived(y, x, c))
+					continue;
+				p = period(y, x, c);
+				if (p > 1)
+					slow++;
+				if (p > p_max)
+					p_max = p;
+			}
+	printf("flicker   %.1f Hz lowest, %u of the lit LEDs below refresh\n",
+	       refresh / p_max, slow);
+}
+
+int main(int argc, char **argv)
+{
+	const char *image = NULL, *source = NULL;
+	const uint16_t *src = test_pattern_image();
+	int opt, verbose = 0;
+
+	while ((opt = getopt(argc, argv, "n:k:F:i:o:v")) != -1) {
+		switch (opt) {
+		case 'n': frames_want = strtoul(optarg, NULL, 0); break;
+		case 'k': bitclock_khz = strtoul(optarg, NULL, 0); break;
+		case 'F': frame_file = optarg; break;
+		case 'i': source = optarg; break;
+		case 'o': image = optarg; break;
+		case 'v': verbose = 1; break;
+		default:
+			fprintf(stderr, "usage: %s [-n frames] [-k khz]"
+				" [-F frame [-i image]]"
+				" [-o image.png|image.rgb] [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (frames_want < 1 || frames_want > MAX_FRAMES) {
+		fprintf(stderr, "1 to %u frames\n", MAX_FRAMES);
+		return 1;
+	}
+
+	if (frame_file) {
+		src = source ? read_image(source) : NULL;
+		if (source && !src)
+			return 1;
+	}
+
+	map_pixels();
+	last = R30_OE;		// as pru_host_run() starts it
+	pru_host_trace(edge, NULL);
+	pru_host_frame(frame, NULL);
+	pru_host_run(0, frames_want + MAX_SETTLE);
+	if (frames < frames_want) {
+		fprintf(stderr, "the timing did not settle in %u frames\n",
+			frames_want + MAX_SETTLE);
+		return 1;
+	}
+
+	report(src, verbose);
+	if (image && write_image(image))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * pru_bench.c
+ *
+ * run the firmware on the host for a while and report what it did.
+ *
+ *   pru_bench [-f frames] [-c cycles] [-k khz] [-l mode] [-s usec]
+ *             [-t trace] [-u lsb] [-e mode] [-d file]
+ *             [-m mem -D ddr -a ddr phys]
+ *
+ * -f/-c  stop after that many frames / virtual cycles (default 100 frames)
+ * -k     pixel clock, as hub75_clock would set it
+ * -l     lock mode (0 free, 1 slave, 2 master), with -s the sync period
+ * -t     write every R30 change as "cycle r30" lines
+ * -u     LSB on-time in cycles, as hub75_clock -l would set it
+ * -e     event trace mode (1 run, 2 stop after a miss), needs a firmware
+ *        built with make TRACE=1
+ * -d     write the control block to file at the end, for the tools in
+ *        ../../tools with -m file (hub75_trace, hub75_stat)
+ * -m     keep the control block in a file, and run in real time, so the
+ *        tools can use the same file with -m while it runs.  the queued
+ *        frames come from -D, a file standing in for the DDR at -a.
+ *        this is the PRU for profiling the host side off-board
+ *        (hub75_queue, hub75_latency).
+ *
+ * the numbers are virtual (PRU cycles), so they only move when the
+ * firmware changes, which makes this the thing to run before and after.
+ * the host time is printed too, for the speed of the encoder and loop.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* pru_mem.h before pru_host.h, which turns ctrl into a macro */
+#include "pru_mem.h"
+#include "pru_host.h"
+
+static uint32_t bitclock_khz, lock_mode, lsb_want, trace_mode;
+static double realtime;		/* host seconds at cycle 0, 0 for none */
+
+
+static void trace_text(uint64_t cycle, uint32_t r30, void *arg)
+{
+	fprintf(arg, "%llu %08x\n", (unsigned long long) cycle, r30);
+}
+
+static double host_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+	ctrl_init() runs in the firmware, so poke after the first frame, only
+	what was asked for (a tool may have set it). with -m hold every frame
+	back until the host clock has caught up.
+*/
+static void poke(uint32_t frame, void *arg)
+{
+	double ahead;
+
+	if (realtime) {
+		ahead = realtime + (double) pru_now / PRU_HZ - host_secs();
+		if (ahead > 0)
+			usleep(ahead * 1e6);
+	}
+	if (frame != 1)
+		return;
+	if (bitclock_khz)
+		ctrl.bitclock_khz = bitclock_khz;
+	if (lock_mode)
+		ctrl.lock_mode = lock_mode;
+	if (lsb_want)
+		ctrl.lsb_want = lsb_want;
+	if (trace_mode)
+		ctrl.trace.mode = trace_mode;
+}
+
+static int dump_ctrl(const char *path)
+{
+	static uint8_t block[SHARED_CTRL_SIZE];
+	FILE *f = fopen(path, "w");
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	memcpy(block, (void *) &ctrl, sizeof(ctrl));
+	if (fwrite(block, sizeof(block), 1, f) != 1 || fclose(f) != 0) {
+		perror(path);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t max_cycles = 0, cycles;
+	uint32_t max_frames = 100, sync_us = 0, frames;
+	FILE *trace = NULL;
+	const char *dump = NULL, *mem = NULL, *ddr = NULL;
+	unsigned long ddr_phys = 0;
+	size_t ddr_len;
+	void *p;
+	double t0, host, secs;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:c:k:l:s:t:u:e:d:m:D:a:")) != -1) {
+		switch (opt) {
+		case 'f': max_frames = strtoul(optarg, NULL, 0); break;
+		case 'c': max_cycles = strtoull(optarg, NULL, 0); break;
+		case 'k': bitclock_khz = strtoul(optarg, NULL, 0); break;
+		case 'l': lock_mode = strtoul(optarg, NULL, 0); break;
+		case 's': sync_us = strtoul(optarg, NULL, 0); break;
+		case 'u': lsb_want = strtoul(optarg, NULL, 0); break;
+		case 'e': trace_mode = strtoul(optarg, NULL, 0); break;
+		case 'd': dump = optarg; break;
+		case 'm': mem = optarg; break;
+		case 'D': ddr = optarg; break;
+		case 'a': ddr_phys = strtoul(optarg, NULL, 0); break;
+		case 't':
+			trace = fopen(optarg, "w");
+			if (!trace) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-f frames] [-c cycles]"
+				" [-k khz] [-l mode] [-s usec] [-t trace]"
+				" [-u lsb] [-e mode] [-d file]"
+				" [-m mem -D ddr -a ddr phys]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (max_cycles)
+		max_frames = 0;
+
+	if (mem) {
+		p = pru_mem_map(mem, PRUSS_SHARED_RAM_PHYS + SHARED_CTRL_OFFSET,
+				SHARED_CTRL_SIZE);
+		if (!p)
+			return 1;
+		pru_host_ctrl_at(p);
+		realtime = host_secs();
+	}
+	if (ddr) {
+		if (!ddr_phys) {
+			fprintf(stderr, "-D needs the address it stands in"
+				" for, -a\n");
+			return 1;
+		}
+		// as much as hub75_queue maps, for the largest frame
+		ddr_len = FRAME_SLOT_SIZE(SHARED_CTRL_OFFSET) * FRAME_QUEUE_LEN;
+		p = pru_mem_map(ddr, ddr_phys, ddr_len);
+		if (!p)
+			return 1;
+		pru_host_ddr(p, ddr_phys, ddr_len);
+	}
+
+	if (trace)
+		pru_host_trace(trace_text, trace);
+	pru_host_frame(poke, NULL);
+	if (sync_us)
+		pru_host_sync_in(sync_us * (PRU_HZ / 1000000), PRU_HZ / 1000000);
+
+	t0 = host_secs();
+	cycles = pru_host_run(max_cycles, max_frames);
+	host = host_secs() - t0;
+	if (trace)
+		fclose(trace);
+	if (dump && dump_ctrl(dump) < 0)
+		return 1;
+
+	secs = (double) cycles / PRU_HZ;
+	frames = ctrl.frame_count;
+	printf("virtual   %.6f s  %llu cycles\n", secs,
+	       (unsigned long long) cycles);
+	printf("frames    %u  refresh %.1f Hz  %.1f us/frame\n", frames,
+	       frames / secs, frames ? secs * 1e6 / frames : 0.0);
+	printf("R30       %llu changes  %llu CLK pulses  pixel clock %.1f MHz\n",
+	       (unsigned long long) pru_stats.r30_changes,
+	       (unsigned long long) pru_stats.clk_pulses,
+	       ctrl.bitclock_now / 1000.0);
+	printf("lit       %.1f %% of the time (OE low)\n",
+	       100.0 * pru_stats.oe_on / (cycles ? cycles : 1));
+	printf("LSB       %u cycles  shift %u cycles\n", ctrl.lsb_cycles,
+	       ctrl.shift_cycles);
+	printf("shifts    %u  avg %u max %u cycles  missed deadlines %u\n",
+	       ctrl.perf.shifted,
+	       ctrl.perf.shifted ? ctrl.perf.shift_sum / ctrl.perf.shifted : 0,
+	       ctrl.perf.shift_max, ctrl.perf.missed);
+	if (ctrl.trace.built && ctrl.trace.mode)
+		printf("trace     %u records%s\n", ctrl.trace.head,
+		       ctrl.trace.stopped ? ", stopped after a miss" : "");
+	printf("skipped   %u black  %u latched planes\n",
+	       ctrl.elide.zero, ctrl.elide.same);
+	if (lock_mode)
+		printf("lock      %s  phase %d  correction %d  missed %u\n",
+		       ctrl.locked ? "locked" : "unlocked", ctrl.lock_phase,
+		       ctrl.lock_corr, ctrl.lock_missed);
+	printf("host      %.3f s  %.2fx real time\n", host,
+	       host > 0 ? secs / host : 0.0);
+	return 0;
+}
@@ -0,0 +1,359 @@
+/*
+ * pru_host.c
+ *
+ * the models behind the shims, see pru_host.h.
+ *
+ * IEP:  the counter runs from the cycle CNT_EN goes up, a compare that
+ *       is enabled and reached raises the IEP event (R31.31, HIPIR1 = 7)
+ *       until the firmware clears it through SICR or SECR0.
+ * CTRL: CYCLE counts while CTR_EN, writes only stick while stopped.
+ *
+ * firmware writes land in the register structs directly, so every shim
+ * call first compares them against the model (pru_sync) before it
+ * moves the clock on.  that way nothing is stamped late.
+ */
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shim/pru_cfg.h"
+#include "shim/pru_ctrl.h"
+#include "shim/pru_iep.h"
+#include "shim/pru_intc.h"
+#include "pru_host.h"
+#include "pru1_pixel_driver.h"
+
+void pru_main(void);
+
+uint64_t pru_now;
+struct pru_host_stats pru_stats;
+
+static volatile uint32_t r30, r30_traced;
+static uint64_t oe_since;
+
+static volatile pruIep iep;
+static volatile pruIntc intc;
+static volatile pruCtrl ctrl_regs;
+static volatile pruCfg cfg;
+
+static int iep_running, iep_event;
+static uint64_t iep_t0;
+static uint32_t iep_cnt0;
+static uint32_t secr0_shown;
+
+static int cyc_running;
+static uint64_t cyc_t0;
+static uint32_t cyc_v0;
+
+static uint32_t sync_period, sync_width;
+
+/* pru_ctrl_block is the firmware's ctrl, see shim/pru_shim.h */
+static struct shared_ctrl own_block;
+
+static uint8_t *ddr_base;
+static uint32_t ddr_phys;
+static size_t ddr_len;
+
+static pru_trace_fn trace_fn;
+static void *trace_arg;
+static pru_frame_fn frame_fn;
+static void *frame_arg;
+static uint32_t frame_seen;
+
+static uint64_t stop_cycles;
+static uint32_t stop_frames;
+static int stop_asked;
+static jmp_buf stop;
+
+#define SICR_IDLE 0x3FF
+
+static void r30_sync(void)
+{
+	uint32_t changed = r30 ^ r30_traced;
+
+	if (!changed)
+		return;
+	if (changed & (1UL << HUB75_OE)) {
+		if (r30 & (1UL << HUB75_OE))	// OE high, panel off
+			pru_stats.oe_on += pru_now - oe_since;
+		else
+			oe_since = pru_now;
+	}
+	if ((changed & r30) & (1UL << HUB75_CLK))
+		pru_stats.clk_pulses++;
+	pru_stats.r30_changes++;
+	r30_traced = r30;
+	if (trace_fn)
+		trace_fn(pru_now, r30, trace_arg);
+}
+
+static void iep_sync(void)
+{
+	volatile uint32_t *cmp = &iep.TMR_CMP0;
+	uint32_t hits = 0;
+	int k;
+
+	if (iep.TMR_GLB_CFG_bit.CNT_EN && !iep_running) {
+		iep_t0 = pru_now;
+		iep_cnt0 = iep.TMR_CNT;
+	}
+	iep_running = iep.TMR_GLB_CFG_bit.CNT_EN;
+	if (iep_running)
+		iep.TMR_CNT = iep_cnt0 + (uint32_t) (pru_now - iep_t0);
+
+	for (k = 0; k < 8; k++)
+		if ((iep.TMR_CMP_CFG_bit.CMP_EN & (1U << k)) &&
+		    iep.TMR_CNT >= cmp[k])
+			hits |= 1U << k;
+	iep.TMR_CMP_STS = hits;
+	if (hits)
+		iep_event = 1;
+}
+
+static void intc_sync(void)
+{
+	if (intc.SICR_bit.STS_CLR_IDX != SICR_IDLE) {
+		if (intc.SICR_bit.STS_CLR_IDX == PRU_IEP_EVT)
+			iep_event = 0;
+		intc.SICR_bit.STS_CLR_IDX = SICR_IDLE;
+	}
+	// write 1 to clear
+	if (intc.SECR0 != secr0_shown && (intc.SECR0 & (1U << PRU_IEP_EVT)))
+		iep_event = 0;
+	secr0_shown = iep_event ? 1U << PRU_IEP_EVT : 0;
+	intc.SECR0 = secr0_shown;
+	intc.HIPIR1 = iep_event ? PRU_IEP_EVT : 0x80000000;
+}
+
+static void cyc_sync(void)
+{
+	if (ctrl_regs.CTRL_bit.CTR_EN && !cyc_running) {
+		cyc_t0 = pru_now;
+		cyc_v0 = ctrl_regs.CYCLE;
+	}
+	cyc_running = ctrl_regs.CTRL_bit.CTR_EN;
+	if (cyc_running)
+		ctrl_regs.CYCLE = cyc_v0 + (uint32_t) (pru_now - cyc_t0);
+}
+
+static void pru_sync(void)
+{
+	r30_sync();
+	iep_sync();
+	intc_sync();
+	cyc_sync();
+
+	if (ctrl.frame_count != frame_seen) {
+		frame_seen = ctrl.frame_count;
+		if (frame_fn)
+			frame_fn(frame_seen, frame_arg);
+	}
+	if (stop_asked || (stop_cycles && pru_now >= stop_cycles) ||
+	    (stop_frames && frame_seen >= stop_frames))
+		longjmp(stop, 1);
+}
+
+/* shims, see shim/pru_shim.h */
+
+volatile uint32_t *pru_r30(void)
+{
+	pru_sync();
+	return &r30;
+}
+
+uint32_t pru_r31(void)
+{
+	uint32_t v = 0;
+
+	pru_sync();
+	if (iep_event)
+		v |= HOST_INT1;
+	if (sync_period && pru_now % sync_period < sync_width)
+		v |= 1UL << HUB75_SYNC_IN;
+	pru_now++;
+	return v;
+}
+
+void pru_asm(const char *text)
+{
+	unsigned int bit;
+
+	while (*text == ' ' || *text == '\t')
+		text++;
+	if (!*text)
+		return;		// nop() emits nothing
+	pru_sync();
+	if (sscanf(text, "SET R30, R30, %u", &bit) == 1)
+		r30 |= 1UL << bit;
+	else if (sscanf(text, "CLR R30, R30, %u", &bit) == 1)
+		r30 &= ~(1UL << bit);
+	r30_sync();
+	pru_now++;
+}
+
+void __delay_cycles(unsigned int cycles)
+{
+	pru_sync();
+	pru_now += cycles;
+}
+
+void __halt(void)
+{
+	pru_sync();
+	longjmp(stop, 1);
+}
+
+volatile pruIep *pru_iep(void)
+{
+	pru_sync();
+	pru_now++;
+	return &iep;
+}
+
+volatile pruIntc *pru_intc(void)
+{
+	pru_sync();
+	pru_now++;
+	return &intc;
+}
+
+volatile pruCtrl *pru_ctrl(void)
+{
+	pru_sync();
+	pru_now++;
+	return &ctrl_regs;
+}
+
+volatile pruCfg *pru_cfg(void)
+{
+	pru_sync();
+	pru_now++;
+	return &cfg;
+}
+
+/*
+	the shift kernels, cycle for cycle as in shift_kernel.asm: 9 cycles
+	in (3 for the first LBBO), then lo cycles with the data out and CLK
+	low and hi with CLK high for every byte, and 2 out.
+*/
+static void shift_model(volatile uint8_t *scanline, uint16_t scanlen,
+			unsigned int lo, unsigned int hi)
+{
+	uint32_t mask;
+	unsigned int i, n = scanlen & ~7U;
+
+	pru_sync();
+	mask = r30 & COLORMASK;
+	if (!n) {
+		pru_now += 6;
+		return;
+	}
+	pru_now += 9;
+	for (i = 0; i < n; i++) {
+		r30 = mask | scanline[i];
+		r30_sync();
+		pru_now += lo;
+		r30 |= 1UL << HUB75_CLK;
+		r30_sync();
+		pru_now += hi;
+	}
+	r30 = mask;
+	r30_sync();
+	pru_now += 2;
+}
+
+void shift_28(volatile uint8_t *scanline, uint16_t scanlen)
+{
+	shift_model(scanline, scanlen, 3, 4);
+}
+
+void shift_25(volatile uint8_t *scanline, uint16_t scanlen)
+{
+	shift_model(scanline, scanlen, 4, 4);
+}
+
+void shift_20(volatile uint8_t *scanline, uint16_t scanlen)
+{
+	shift_model(scanline, scanlen, 5, 5);
+}
+
+/* run control */
+
+void pru_host_trace(pru_trace_fn fn, void *arg)
+{
+	trace_fn = fn;
+	trace_arg = arg;
+}
+
+void pru_host_frame(pru_frame_fn fn, void *arg)
+{
+	frame_fn = fn;
+	frame_arg = arg;
+}
+
+int pru_host_iep_armed(uint32_t *cmp)
+{
+	uint32_t en = iep.TMR_CMP_CFG_bit.CMP_EN;
+	int k;
+
+	if (!en || (en & (en - 1)))
+		return -1;
+	for (k = 0; !(en & (1U << k)); k++)
+		;
+	if (cmp)
+		*cmp = (&iep.TMR_CMP0)[k];
+	return k;
+}
+
+void pru_host_sync_in(uint32_t period, uint32_t width)
+{
+	sync_period = period;
+	sync_width = width;
+}
+
+void pru_host_ctrl_at(volatile struct shared_ctrl *block)
+{
+	pru_ctrl_block = block;
+}
+
+void pru_host_ddr(void *base, uint32_t phys, size_t len)
+{
+	ddr_base = base;
+	ddr_phys = phys;
+	ddr_len = len;
+}
+
+void *pru_host_global(uint32_t addr)
+{
+	if (!ddr_base || addr < ddr_phys || addr - ddr_phys >= ddr_len) {
+		fprintf(stderr, "pru_host: global address 0x%08x outside"
+			" the DDR stand-in\n", addr);
+		exit(1);
+	}
+	return ddr_base + (addr - ddr_phys);
+}
+
+void pru_host_stop(void)
+{
+	stop_asked = 1;
+}
+
+uint64_t pru_host_run(uint64_t max_cycles, uint32_t max_frames)
+{
+	if (!pru_ctrl_block)
+		pru_ctrl_block = &own_block;
+	stop_cycles = max_cycles;
+	stop_frames = max_frames;
+	stop_asked = 0;
+	intc.SICR_bit.STS_CLR_IDX = SICR_IDLE;
+	r30 = r30_traced = 1UL << HUB75_OE;	// OE is pulled up
+
+	if (!setjmp(stop))
+		pru_main();
+
+	if (!(r30 & (1UL << HUB75_OE)))
+		pru_stats.oe_on += pru_now - oe_since;
+	return pru_now;
+}
@@ -0,0 +1,73 @@
+/*
+ * pru_host.h
+ *
+ * run the PRU firmware on the host, on a virtual cycle clock.
+ *
+ * pru1_pixel_driver.c and test_pattern.c are built with shim/pru_shim.h
+ * forced in front and main renamed to pru_main.  the shims advance the
+ * clock the way the PRU would spend it:
+ *
+ *   asm SET/CLR, R31 read, register access	1 cycle
+ *   __delay_cycles(n)				n cycles
+ *   shift kernels				as timed in shift_kernel.asm
+ *
+ * plain C between them is free, so a run is a little fast but all the
+ * waiting the firmware does is on the IEP, which is modelled exactly.
+ * every change of R30 goes to the trace hook, stamped with the cycle it
+ * happened in.
+ */
+
+#ifndef PRU_HOST_H
+#define PRU_HOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shared_ctrl.h"
+
+#define PRU_HZ		200000000ULL
+
+/* the firmware's view, shared with the host like on the board */
+extern volatile struct shared_ctrl *pru_ctrl_block;
+#define ctrl (*pru_ctrl_block)
+extern volatile uint8_t buffer[];
+
+extern uint64_t pru_now;		/* virtual cycles since reset */
+
+struct pru_host_stats {
+	uint64_t r30_changes;
+	uint64_t clk_pulses;		/* rising edges of CLK */
+	uint64_t oe_on;			/* cycles with OE low, panel lit */
+};
+extern struct pru_host_stats pru_stats;
+
+/* called with every change of R30, in cycle order */
+typedef void (*pru_trace_fn)(uint64_t cycle, uint32_t r30, void *arg);
+void pru_host_trace(pru_trace_fn fn, void *arg);
+
+/* called at every frame boundary, e.g. to poke ctrl like the host would */
+typedef void (*pru_frame_fn)(uint32_t frame, void *arg);
+void pru_host_frame(pru_frame_fn fn, void *arg);
+
+/* the one IEP compare enabled now (-1 if none or several), its value in *cmp */
+int pru_host_iep_armed(uint32_t *cmp);
+
+/* a sync pulse on R31.16 every period cycles, high for width */
+void pru_host_sync_in(uint32_t period, uint32_t width);
+
+/*
+ * put the control block somewhere else than the one of its own, e.g. a
+ * file the tools map too (see ../../tools/pru_mem.h).  before the run.
+ */
+void pru_host_ctrl_at(volatile struct shared_ctrl *block);
+
+/* DDR from phys on, for the queued frames (GLOBAL_ADDR() in the shim) */
+void pru_host_ddr(void *base, uint32_t phys, size_t len);
+
+/* run the firmware until either limit (0 for none), returns pru_now */
+uint64_t pru_host_run(uint64_t max_cycles, uint32_t max_frames);
+
+/* from a hook, end the run before the firmware goes on */
+void pru_host_stop(void);
+
+#endif /* PRU_HOST_H */
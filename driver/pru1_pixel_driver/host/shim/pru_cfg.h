@@ -0,0 +1,24 @@
+/* host shim of the PRU_SSP pru_cfg.h, only what the firmware uses */
+
+#ifndef _PRU_CFG_H_
+#define _PRU_CFG_H_
+
+#include <stdint.h>
+
+typedef struct {
+	union {
+		volatile uint32_t SYSCFG;
+		volatile struct {
+			unsigned IDLE_MODE : 2;
+			unsigned STANDBY_MODE : 2;
+			unsigned STANDBY_INIT : 1;
+			unsigned SUB_MWAIT : 1;
+			unsigned rsvd6 : 26;
+		} SYSCFG_bit;
+	};
+} pruCfg;
+
+volatile pruCfg *pru_cfg(void);
+#define CT_CFG (*pru_cfg())
+
+#endif /* _PRU_CFG_H_ */
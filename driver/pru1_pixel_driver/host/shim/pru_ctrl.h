@@ -0,0 +1,32 @@
+/* host shim of the PRU_SSP pru_ctrl.h, only what the firmware uses */
+
+#ifndef _PRU_CTRL_H_
+#define _PRU_CTRL_H_
+
+#include <stdint.h>
+
+typedef struct {
+	union {
+		volatile uint32_t CTRL;
+		volatile struct {
+			unsigned SOFT_RST_N : 1;
+			unsigned EN : 1;
+			unsigned SLEEPING : 1;
+			unsigned CTR_EN : 1;
+			unsigned rsvd4 : 4;
+			unsigned SINGLE_STEP : 1;
+			unsigned rsvd9 : 6;
+			unsigned RUNSTATE : 1;
+			unsigned PCTR_RST_VAL : 16;
+		} CTRL_bit;
+	};
+	volatile uint32_t STS;
+	volatile uint32_t WAKEUP_EN;
+	volatile uint32_t CYCLE;	/* counts while CTR_EN, see pru_host.c */
+	volatile uint32_t STALL;
+} pruCtrl;
+
+volatile pruCtrl *pru_ctrl(void);
+#define PRU1_CTRL (*pru_ctrl())
+
+#endif /* _PRU_CTRL_H_ */
@@ -0,0 +1,63 @@
+/* host shim of the PRU_SSP pru_iep.h, only what the firmware uses */
+
+#ifndef _PRU_IEP_H_
+#define _PRU_IEP_H_
+
+#include <stdint.h>
+
+typedef struct {
+	union {
+		volatile uint32_t TMR_GLB_CFG;
+		volatile struct {
+			unsigned CNT_EN : 1;
+			unsigned rsvd1 : 3;
+			unsigned DEFAULT_INC : 4;
+			unsigned CMP_INC : 12;
+			unsigned rsvd12 : 12;
+		} TMR_GLB_CFG_bit;
+	};
+	union {
+		volatile uint32_t TMR_GLB_STS;
+		volatile struct {
+			unsigned CNT_OVF : 1;
+			unsigned rsvd1 : 31;
+		} TMR_GLB_STS_bit;
+	};
+	union {
+		volatile uint32_t TMR_COMPEN;
+		volatile struct {
+			unsigned COMPEN_CNT : 24;
+			unsigned rsvd24 : 8;
+		} TMR_COMPEN_bit;
+	};
+	volatile uint32_t TMR_CNT;
+	union {
+		volatile uint32_t TMR_CMP_CFG;
+		volatile struct {
+			unsigned CMP0_RST_CNT_EN : 1;
+			unsigned CMP_EN : 8;
+			unsigned rsvd9 : 23;
+		} TMR_CMP_CFG_bit;
+	};
+	union {
+		volatile uint32_t TMR_CMP_STS;
+		volatile struct {
+			unsigned CMP_HIT : 8;
+			unsigned rsvd8 : 24;
+		} TMR_CMP_STS_bit;
+	};
+	/* contiguous, like the hardware */
+	volatile uint32_t TMR_CMP0;
+	volatile uint32_t TMR_CMP1;
+	volatile uint32_t TMR_CMP2;
+	volatile uint32_t TMR_CMP3;
+	volatile uint32_t TMR_CMP4;
+	volatile uint32_t TMR_CMP5;
+	volatile uint32_t TMR_CMP6;
+	volatile uint32_t TMR_CMP7;
+} pruIep;
+
+volatile pruIep *pru_iep(void);
+#define CT_IEP (*pru_iep())
+
+#endif /* _PRU_IEP_H_ */
@@ -0,0 +1,50 @@
+/* host shim of the PRU_SSP pru_intc.h, only what the firmware uses */
+
+#ifndef _PRU_INTC_H_
+#define _PRU_INTC_H_
+
+#include <stdint.h>
+
+typedef struct {
+	volatile uint32_t GER;
+	union {
+		volatile uint32_t SICR;
+		volatile struct {
+			unsigned STS_CLR_IDX : 10;
+			unsigned rsvd10 : 22;
+		} SICR_bit;
+	};
+	volatile uint32_t HIPIR1;	/* 7 while the IEP event is pending */
+	volatile uint32_t SECR0;
+	volatile uint32_t SECR1;
+	volatile uint32_t SIPR0;
+	volatile uint32_t ESR0;
+	union {
+		volatile uint32_t CMR1;
+		volatile struct {
+			unsigned CH_MAP_4 : 4;
+			unsigned rsvd4 : 4;
+			unsigned CH_MAP_5 : 4;
+			unsigned rsvd12 : 4;
+			unsigned CH_MAP_6 : 4;
+			unsigned rsvd20 : 4;
+			unsigned CH_MAP_7 : 4;
+			unsigned rsvd28 : 4;
+		} CMR1_bit;
+	};
+	union {
+		volatile uint32_t HMR0;
+		volatile struct {
+			unsigned HINT_MAP_0 : 4;
+			unsigned rsvd4 : 4;
+			unsigned HINT_MAP_1 : 4;
+			unsigned rsvd12 : 20;
+		} HMR0_bit;
+	};
+	volatile uint32_t HIER;
+} pruIntc;
+
+volatile pruIntc *pru_intc(void);
+#define CT_INTC (*pru_intc())
+
+#endif /* _PRU_INTC_H_ */
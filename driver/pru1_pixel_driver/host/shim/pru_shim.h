@@ -0,0 +1,46 @@
+/*
+ * pru_shim.h
+ *
+ * forced in front of the firmware sources (-include) for the host build,
+ * see ../pru_host.c.  turns the clpru specific bits into plain C:
+ *
+ *   far, register	gone
+ *   __R30		a variable, every change is stamped and traced
+ *   __R31		a read of the modelled inputs (IEP event, sync in)
+ *   asm(" SET R30 ..")	SET/CLR of R30, anything else is a nop
+ *   __delay_cycles(n)	n virtual cycles
+ *   ctrl		through a pointer, so a tool can put it in a file
+ *   GLOBAL_ADDR()	into the DDR stand-in, see pru_host_ddr()
+ *
+ * the peripheral registers (CT_IEP, CT_INTC, PRU1_CTRL, CT_CFG) are
+ * reached through functions in the shim headers for the same reason:
+ * each access brings the models up to the virtual clock first.
+ */
+
+#ifndef PRU_SHIM_H
+#define PRU_SHIM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define far
+#define register
+
+volatile uint32_t *pru_r30(void);
+uint32_t pru_r31(void);
+void pru_asm(const char *text);
+void __delay_cycles(unsigned int cycles);
+void __halt(void);
+
+struct shared_ctrl;
+extern volatile struct shared_ctrl *pru_ctrl_block;
+void *pru_host_global(uint32_t addr);
+
+#define ctrl (*pru_ctrl_block)
+#define GLOBAL_ADDR(addr) pru_host_global(addr)
+
+#define __R30 (*pru_r30())
+#define __R31 (pru_r31())
+#define asm(text) pru_asm(text)
+
+#endif /* PRU_SHIM_H */
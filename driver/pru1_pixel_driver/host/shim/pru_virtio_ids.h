@@ -0,0 +1 @@
+/* host shim, nothing from PRU_SSP pru_virtio_ids.h is used */
@@ -0,0 +1,38 @@
+/* host shim of the PRU_SSP rsc_types.h, only what rsc_table_pru.h uses */
+
+#ifndef _RSC_TYPES_H_
+#define _RSC_TYPES_H_
+
+#include <stdint.h>
+
+#define TYPE_CUSTOM	5
+#define TYPE_PRU_INTS	1
+
+struct resource_table {
+	uint32_t ver;
+	uint32_t num;
+	uint32_t reserved[2];
+};
+
+struct ch_map {
+	uint8_t evt;
+	uint8_t ch;
+};
+
+struct fw_rsc_custom_ints {
+	uint16_t version;
+	uint8_t channel_host[10];
+	uint32_t num_evts;
+	struct ch_map *event_channel;
+};
+
+struct fw_rsc_custom {
+	uint32_t type;
+	uint32_t sub_type;
+	uint32_t rsc_size;
+	union {
+		struct fw_rsc_custom_ints pru_ints;
+	} rsc;
+};
+
+#endif /* _RSC_TYPES_H_ */
@@ -0,0 +1,357 @@
+/*
+ * wave_sim.c
+ *
+ * the HUB75 signals the firmware drives, from the host build (see
+ * pru_host.h), checked against the panel driver's timing and written
+ * out as a VCD for gtkwave & co.
+ *
+ *   wave_sim [-f frames] [-k khz] [-l mode] [-s usec] [-o file.vcd]
+ *            [-C rule=ns]... [-v]
+ *
+ * -f/-k/-l/-s  as pru_bench
+ * -o           VCD of CLK, LAT, OE, the address and both RGB triplets
+ *              (rgb bit 0 is R) and sync out, 1 ns resolution
+ * -C           change a limit, e.g. -C clk_lo=20 for a slower driver
+ * -v           print every violation (the first 10 otherwise)
+ *
+ * the rules, all minimums in ns:
+ *
+ *   clk_hi   CLK high time
+ *   clk_lo   CLK low time
+ *   setup    data stable before CLK rises
+ *   hold     data stable after CLK rises
+ *   clk_lat  last CLK rise to LAT rise
+ *   lat      LAT pulse width
+ *   addr     address stable before OE goes low (row driver settle)
+ *   blank    OE high before the address or LAT changes, a change with
+ *            the panel lit always fails it (ghosting)
+ *
+ * the defaults are those of a typical 25 MHz constant current driver.
+ * every lit interval is matched with the IEP compare that times it, so
+ * the on-time of each plane is compared with what the timing asked for.
+ * exits 1 if any rule failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pru_host.h"
+#include "panel_wiring.h"
+#include "pru1_pixel_driver.h"
+
+/* the pins as R30 masks */
+#define R30_DATA	HUB75_DATA
+#define R30_CLK		(1UL << HUB75_CLK)
+#define R30_ADDR	(~LSMASK)
+#define R30_LAT		(1UL << HUB75_LAT)
+#define R30_OE		(1UL << HUB75_OE)
+#define R30_SYNC_OUT	(1UL << HUB75_SYNC_OUT)
+
+#define NS(cycles)	((int64_t) (cycles) * 5)
+
+enum { CLK_HI, CLK_LO, SETUP, HOLD, CLK_LAT, LAT, ADDR, BLANK, N_RULES };
+
+static struct rule {
+	const char *name;
+	int64_t min;		/* ns */
+	int64_t worst;		/* ns, smallest seen */
+	uint64_t checks, fails;
+} rules[N_RULES] = {
+	[CLK_HI]  = { "clk_hi",  15 },
+	[CLK_LO]  = { "clk_lo",  15 },
+	[SETUP]   = { "setup",    5 },
+	[HOLD]    = { "hold",     5 },
+	[CLK_LAT] = { "clk_lat", 10 },
+	[LAT]     = { "lat",     20 },
+	[ADDR]    = { "addr",   100 },
+	[BLANK]   = { "blank",    0 },
+};
+
+static struct plane {
+	uint64_t n;
+	int64_t want;		/* ns, summed */
+	int64_t got;		/* ns, summed */
+	int64_t err_max;	/* ns, largest |error| */
+} plane[N_BITS];
+
+static uint32_t bitclock_khz, lock_mode;
+static int verbose, shown;
+static FILE *vcd;
+
+/* when each thing last happened, in cycles */
+static uint32_t last;
+static uint64_t t_clk_rise, t_clk_fall, t_data, t_addr;
+static uint64_t t_lat_rise, t_oe_rise, t_oe_fall;
+static int oe_bit = -1;
+static uint32_t oe_want;
+
+static void check(int r, uint64_t cycle, int64_t ns)
+{
+	struct rule *rule = &rules[r];
+
+	if (!rule->checks || ns < rule->worst)
+		rule->worst = ns;
+	rule->checks++;
+	if (ns >= rule->min)
+		return;
+	rule->fails++;
+	if (verbose || shown < 10) {
+		shown++;
+		if (ns < 0)
+			printf("%12.3f us  %-8s panel lit\n",
+			       NS(cycle) / 1000.0, rule->name);
+		else
+			printf("%12.3f us  %-8s %lld ns < %lld ns\n",
+			       NS(cycle) / 1000.0, rule->name,
+			       (long long) ns, (long long) rule->min);
+	}
+}
+
+/* OE high time before a change, -1 while lit */
+static int64_t blank_ns(uint64_t cycle)
+{
+	return (last & R30_OE) ? NS(cycle - t_oe_rise) : -1;
+}
+
+static void on_time(uint64_t cycle)
+{
+	struct plane *p = &plane[oe_bit];
+	int64_t got = NS(cycle - t_oe_fall), err = got - NS(oe_want);
+
+	p->n++;
+	p->want += NS(oe_want);
+	p->got += got;
+	if (err < 0)
+		err = -err;
+	if (err > p->err_max)
+		p->err_max = err;
+}
+
+static void vcd_bits(uint32_t v, int n, char id)
+{
+	fputc('b', vcd);
+	while (n--)
+		fputc(v & (1UL << n) ? '1' : '0', vcd);
+	fprintf(vcd, " %c\n", id);
+}
+
+static void vcd_dump(uint32_t r30, uint32_t changed)
+{
+	if (changed & R30_CLK)
+		fprintf(vcd, "%d!\n", !!(r30 & R30_CLK));
+	if (changed & R30_LAT)
+		fprintf(vcd, "%d\"\n", !!(r30 & R30_LAT));
+	if (changed & R30_OE)
+		fprintf(vcd, "%d#\n", !!(r30 & R30_OE));
+	if (changed & R30_ADDR)
+		vcd_bits(r30 >> 7, 3, '$');
+	if (changed & 0x07)
+		vcd_bits(r30, 3, '%');
+	if (changed & 0x38)
+		vcd_bits(r30 >> 3, 3, '&');
+	if (changed & R30_SYNC_OUT)
+		fprintf(vcd, "%d'\n", !!(r30 & R30_SYNC_OUT));
+}
+
+static void vcd_header(uint32_t r30)
+{
+	fprintf(vcd, "$version wave_sim $end\n"
+		"$timescale 1 ns $end\n"
+		"$scope module hub75 $end\n"
+		"$var wire 1 ! clk $end\n"
+		"$var wire 1 \" lat $end\n"
+		"$var wire 1 # oe $end\n"
+		"$var wire 3 $ addr $end\n"
+		"$var wire 3 %% rgb1 $end\n"
+		"$var wire 3 & rgb2 $end\n"
+		"$var wire 1 ' sync_out $end\n"
+		"$upscope $end\n"
+		"$enddefinitions $end\n"
+		"#0\n"
+		"$dumpvars\n");
+	vcd_dump(r30, ~0U);
+	fprintf(vcd, "$end\n");
+}
+
+/* the trace hook, every change of R30 */
+static void edge(uint64_t cycle, uint32_t r30, void *arg)
+{
+	uint32_t changed = r30 ^ last;
+	uint32_t rise = changed & r30, fall = changed & last;
+
+	if (vcd) {
+		fprintf(vcd, "#%lld\n", (long long) NS(cycle));
+		vcd_dump(r30, changed);
+	}
+
+	if (changed & R30_DATA) {
+		if (t_clk_rise)
+			check(HOLD, cycle, NS(cycle - t_clk_rise));
+		t_data = cycle;
+	}
+	if (rise & R30_CLK) {
+		if (t_clk_fall)
+			check(CLK_LO, cycle, NS(cycle - t_clk_fall));
+		check(SETUP, cycle, NS(cycle - t_data));
+		t_clk_rise = cycle;
+	}
+	if ((fall & R30_CLK) && t_clk_rise) {
+		check(CLK_HI, cycle, NS(cycle - t_clk_rise));
+		t_clk_fall = cycle;
+	}
+
+	if (changed & R30_ADDR) {
+		check(BLANK, cycle, blank_ns(cycle));
+		t_addr = cycle;
+	}
+	if (rise & R30_LAT) {
+		check(BLANK, cycle, blank_ns(cycle));
+		if (t_clk_rise)
+			check(CLK_LAT, cycle, NS(cycle - t_clk_rise));
+		t_lat_rise = cycle;
+	}
+	if ((fall & R30_LAT) && t_lat_rise)
+		check(LAT, cycle, NS(cycle - t_lat_rise));
+
+	if (fall & R30_OE) {
+		check(ADDR, cycle, NS(cycle - t_addr));
+		oe_bit = pru_host_iep_armed(&oe_want);
+		if (oe_bit >= N_BITS || oe_bit >= DIM_TIMER)
+			oe_bit = -1;
+		t_oe_fall = cycle;
+	}
+	if (rise & R30_OE) {
+		if (oe_bit >= 0)
+			on_time(cycle);
+		oe_bit = -1;
+		t_oe_rise = cycle;
+	}
+	last = r30;
+}
+
+/* ctrl_init() runs in the firmware, so poke after the first frame */
+static void poke(uint32_t frame, void *arg)
+{
+	if (frame != 1)
+		return;
+	ctrl.bitclock_khz = bitclock_khz;
+	ctrl.lock_mode = lock_mode;
+}
+
+static int set_rule(const char *arg)
+{
+	const char *eq = strchr(arg, '=');
+	int r;
+
+	for (r = 0; eq && r < N_RULES; r++)
+		if (strlen(rules[r].name) == (size_t) (eq - arg) &&
+		    !strncmp(rules[r].name, arg, eq - arg)) {
+			rules[r].min = strtoll(eq + 1, NULL, 0);
+			return 0;
+		}
+	fprintf(stderr, "unknown rule %s, one of:", arg);
+	for (r = 0; r < N_RULES; r++)
+		fprintf(stderr, " %s", rules[r].name);
+	fprintf(stderr, "\n");
+	return -1;
+}
+
+static void report(uint64_t cycles)
+{
+	double secs = (double) cycles / PRU_HZ;
+	uint32_t frames = ctrl.frame_count;
+	uint64_t fails = 0;
+	int r, bit;
+
+	printf("frames    %u  refresh %.1f Hz  pixel clock %.1f MHz\n", frames,
+	       frames / secs, ctrl.bitclock_now / 1000.0);
+	printf("duty      %.2f %% lit (OE low)\n",
+	       100.0 * pru_stats.oe_on / (cycles ? cycles : 1));
+
+	printf("\nrule      min ns  worst ns      checks   fails\n");
+	for (r = 0; r < N_RULES; r++) {
+		struct rule *rule = &rules[r];
+
+		fails += rule->fails;
+		if (!rule->checks) {
+			printf("%-8s %7lld         -           0\n", rule->name,
+			       (long long) rule->min);
+			continue;
+		}
+		printf("%-8s %7lld %9lld %11llu %7llu%s\n", rule->name,
+		       (long long) rule->min, (long long) rule->worst,
+		       (unsigned long long) rule->checks,
+		       (unsigned long long) rule->fails,
+		       rule->fails ? "  FAIL" : "");
+	}
+
+	printf("\nplane     shown   want us    got us   error ns  max |err| ns\n");
+	for (bit = 0; bit < N_BITS; bit++) {
+		struct plane *p = &plane[bit];
+
+		if (!p->n)
+			continue;
+		printf("%-5d %9llu %9.3f %9.3f %10.1f %13lld\n", bit,
+		       (unsigned long long) p->n, p->want / 1000.0 / p->n,
+		       p->got / 1000.0 / p->n,
+		       (double) (p->got - p->want) / p->n,
+		       (long long) p->err_max);
+	}
+	printf("\n%s\n", fails ? "FAILED" : "ok");
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t max_frames = 10, sync_us = 0;
+	const char *vcd_name = NULL;
+	uint64_t cycles;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:k:l:s:o:C:v")) != -1) {
+		switch (opt) {
+		case 'f': max_frames = strtoul(optarg, NULL, 0); break;
+		case 'k': bitclock_khz = strtoul(optarg, NULL, 0); break;
+		case 'l': lock_mode = strtoul(optarg, NULL, 0); break;
+		case 's': sync_us = strtoul(optarg, NULL, 0); break;
+		case 'o': vcd_name = optarg; break;
+		case 'v': verbose = 1; break;
+		case 'C':
+			if (set_rule(optarg))
+				return 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-f frames] [-k khz] [-l mode]"
+				" [-s usec] [-o file.vcd] [-C rule=ns]... [-v]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (vcd_name) {
+		vcd = fopen(vcd_name, "w");
+		if (!vcd) {
+			perror(vcd_name);
+			return 1;
+		}
+	}
+
+	last = R30_OE;		// as pru_host_run() starts it
+	if (vcd)
+		vcd_header(last);
+	pru_host_trace(edge, NULL);
+	pru_host_frame(poke, NULL);
+	if (sync_us)
+		pru_host_sync_in(sync_us * (PRU_HZ / 1000000), PRU_HZ / 1000000);
+
+	cycles = pru_host_run(0, max_frames);
+	if (vcd)
+		fclose(vcd);
+
+	report(cycles);
+	for (opt = 0; opt < N_RULES; opt++)
+		if (rules[opt].fails)
+			return 1;
+	return 0;
+}
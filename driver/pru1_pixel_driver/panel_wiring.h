@@ -1,12 +1,11 @@
 #include <stdint.h>
 
-#define N_BITS   4
-
 #ifdef SMALL_P10
 
 #define W_PANEL 32
 #define H_PANEL 16
 #define N_LINES  4
+#define N_BITS   4
 #define V_LAYOUT 1  // wire vertically first, then horizontally
 #define B_LEN 8
 #define MAX_PANELS 10
@@ -36,4 +35,12 @@
 #define G2_VAL (1U<<4)
 #define B2_VAL (1U<<3)
 
-#endif
\ No newline at end of file
+#endif
+
+// current limiter, see frame_timing() in test_pattern.c
+#define LED_UA   20000UL  // drive current of one lit LED, set by the driver ICs
+#define LIMIT_MA 0UL      // supply budget for the whole wall, 0 for no limit
+
+// slowest full frame a profile may have, checked at build time against
+// refresh_plan.h
+#define REFRESH_MIN 200UL // Hz
@@ -36,31 +36,19 @@
 #include <pru_cfg.h>
 #include <pru_intc.h>
 #include <pru_iep.h>
+#include <pru_ctrl.h>
 #include "rsc_table_pru.h"
+#include "shared_ctrl.h"
+#include "frame_lock.h"
+#include "refresh_plan.h"
 
 volatile register uint32_t __R30;
 volatile register uint32_t __R31;
 
 #define PRU0
 
-#define PRU_IEP_EVT	7
-#define HOST_INT1	0x80000000
-
-
 #include "panel_wiring.h"
-
-#define HUB75_B    8 /* "P8.27"  pru1: pr1_pru1_pru_r30_8,  B   */
-#define HUB75_LAT 10 /* "P8.28"  pru1: pr1_pru1_pru_r30_10, LAT */
-#define HUB75_C    9 /* "P8.29"  pru1: pr1_pru1_pru_r30_9,  C   */
-#define HUB75_OE  11 /* "P8.30"  pru1: pr1_pru1_pru_r30_11, OE  */
-#define HUB75_CLK  6 /* "P8.39"  pru1: pr1_pru1_pru_r30_6,  CLK */
-#define HUB75_A    7 /* "P8.40"  pru1: pr1_pru1_pru_r30_7,  A   */
-#define HUB75_G2   4 /* "P8.41"  pru1: pr1_pru1_pru_r31_4,  G2  */
-#define HUB75_B2   5 /* "P8.42"  pru1: pr1_pru1_pru_r31_5,  B2  */
-#define HUB75_B1   2 /* "P8.43"  pru1: pr1_pru1_pru_r30_2,  B1  */
-#define HUB75_R2   3 /* "P8.44"  pru1: pr1_pru1_pru_r30_3,  R2  */
-#define HUB75_R1   0 /* "P8.45"  pru1: pr1_pru1_pru_r30_0,  R1  */
-#define HUB75_G1   1 /* "P8.46"  pru1: pr1_pru1_pru_r30_1,  G1  */
+#include "pru1_pixel_driver.h"
 
 //#define SET_OE()  asm(" SET R31, R31, " # HUB75_OE)
 //#define CLR_OE()  asm(" CLR R31, R31, " # HUB75_OE)
@@ -75,10 +63,6 @@ volatile register uint32_t __R31;
 //#define DO_TOG(bit) __R30 ^=  (1UL<<bit)
 
 
-#define COLORMASK ~0x7FUL  // 6 colors + CLK
-
-#define LSMASK ~((1UL << HUB75_A) | (1UL << HUB75_B) | (1UL << HUB75_C))
-
 static const uint32_t line_setting[] = {
 	      0        |       0        |       0        , 
 	(1 << HUB75_A) |       0        |       0        , 
@@ -100,14 +84,14 @@ static void config_ocp(){
 	CT_CFG.SYSCFG_bit.STANDBY_INIT = 0;
 }
 
-#define COLOR_MIN  100UL
 #define BIT0_DELAY 1*COLOR_MIN
 #define BIT1_DELAY 2*COLOR_MIN
 #define BIT2_DELAY 4*COLOR_MIN
 #define BIT3_DELAY 8*COLOR_MIN
 #define BIT4_DELAY 16*COLOR_MIN
-#define DIM_DELAY  1500UL
-#define DIM_TIMER  5
+// what a plane costs besides its on-time, at 25 MHz (8 cycles a byte,
+// see shift_kernel.asm and refresh_plan.h). only used to estimate current.
+#define PLANE_OVERHEAD(scanlen) PLAN_PLANE_OVERHEAD(scanlen, 8UL, DIM_DELAY)
 
 void iep_timer_config(void)
 {
@@ -120,6 +104,7 @@ void iep_timer_config(void)
 	CT_IEP.TMR_CMP3 = BIT3_DELAY;               /* Set compare3 value */
 	CT_IEP.TMR_CMP4 = BIT4_DELAY;				/* Set compare4 value */
 	CT_IEP.TMR_CMP5 = DIM_DELAY;				/* Set compare5 value */
+	CT_IEP.TMR_CMP6 = SKIP_DELAY;				/* Set compare6 value */
 	CT_IEP.TMR_CMP_STS_bit.CMP_HIT = 0xFF;		/* Clear compare status */
 	CT_IEP.TMR_COMPEN_bit.COMPEN_CNT = 0x0;             /* Disable compensation */
 	CT_IEP.TMR_CMP_CFG_bit.CMP0_RST_CNT_EN = 0x0;       /* Disable CMP0 and reset on event */
@@ -130,8 +115,12 @@ void iep_timer_config(void)
 	CT_INTC.SECR1 = 0xFFFFFFFF;
 }
 
+/* compare armed last, see iep_timer_wait() */
+static uint8_t timer_armed;
+
 void iep_timer_start(unsigned int cmp)
 {
+	timer_armed = cmp;
 	/* Enable Compare Value */
 	CT_IEP.TMR_CMP_CFG_bit.CMP_EN = (1 << cmp);
 
@@ -139,15 +128,58 @@ void iep_timer_start(unsigned int cmp)
 	CT_IEP.TMR_GLB_CFG_bit.CNT_EN = 0x1;          /* Enable counter */
 }
 
+static uint8_t lock_mode = LOCK_FREE;
+static uint8_t sync_seen;
+static uint32_t sync_level;
+static uint32_t sync_phase;
+
+static inline void sync_poll(void)
+{
+	uint32_t level = __R31 & (1UL << HUB75_SYNC_IN);
+
+	// CYCLE restarts every frame, so it is the phase of the edge
+	if (level && !sync_level && !sync_seen) {
+		sync_phase = PRU1_CTRL.CYCLE;
+		sync_seen = 1;
+	}
+	sync_level = level;
+}
+
+/*
+	timer waits entered after the interval was up, see perf_flush().
+	SKIP_TIMER after a black plane is shorter than the way to the next
+	wait, it is always up by then and is no deadline.
+*/
+static uint16_t waits_late;
+
+#ifdef PRU_TRACE
+static void trace_late(void);
+#else
+#define trace_late()
+#endif
+
 void iep_timer_wait(void)
 {
+	if ((__R31 & HOST_INT1) && timer_armed != SKIP_TIMER) {
+		waits_late++;
+		trace_late();
+	}
 #if 1
+	if (lock_mode == LOCK_SLAVE) {
+		/* same, but watch the sync input while we are idle anyway */
+		do {
+			while ((__R31 & HOST_INT1) == 0) {
+				sync_poll();
+			}
+		} while (CT_INTC.HIPIR1 != PRU_IEP_EVT);
+	} else {
 		/* Detect IEP Timer interrupt */
-	do {
-		while ((__R31 & HOST_INT1) == 0) {
-		}
-		/* Verify that the IEP is the source of the interrupt */
-	} while (CT_INTC.HIPIR1 != PRU_IEP_EVT);
+		do {
+			while ((__R31 & HOST_INT1) == 0) {
+			}
+			/* Verify that the IEP is the source of the interrupt */
+		} while (CT_INTC.HIPIR1 != PRU_IEP_EVT);
+	}
 #else
 	/* Poll until R31.31 is set */
 	do {
@@ -199,68 +231,34 @@ static void intc_config(void){
 }
 #endif
 
-#define nop() asm(" ")
-#define nop2() asm(" MOV R14, R14")
-
-#define BITCLOCK 25
-
-static void shift_scanline(volatile uint8_t *scanline, uint16_t scanlen) {
-	uint8_t color;
-	uint16_t i;
-	register uint32_t output_masked = __R30 & COLORMASK;
-	// careful... this C code checked carefully for ASM tightness
-	// 8 cycles would be 25 MHz... should be evenly spaced
-	// but hard to tell with my equipment
-#if BITCLOCK == 25
-	for (i=0; i< scanlen; i++) {
-		color = *scanline;    					// 3 cycles
-		DO_CLR(HUB75_CLK);    					// 1 cycle
-		__R30 = output_masked | color ; 		// 1 cycle
-		nop();								    // 1 cycle nop
-		scanline++;								// 1 cycle
-		DO_SET(HUB75_CLK);   					// 1 cycle		
-	}
-	__delay_cycles(4);	
-	__R30 = output_masked;
-#elif BITCLOCK == 20 // 20 MHz
-	for (i=0; i< scanlen; i++) {
-		color = *scanline;    					// 3 cycles
-		DO_CLR(HUB75_CLK);    					// 1 cycle
-		nop();
-		__R30 = output_masked | color ; 		// 1 cycle (clock also set to 0)
-		nop();
-		nop();								    // 1 cycle nop
-		nop();
-		scanline++;								// 1 cycle
-		DO_SET(HUB75_CLK);   					// 1 cycle		
-	}
-	__delay_cycles(4);	
-	__R30 = output_masked;
-	
-#else
-	for (i=0; i< scanlen; i++) {
-		color = *scanline;    					// 3 cycles
-		nop2();
-		DO_CLR(HUB75_CLK);    					// 1 cycle
-		nop2();
-		nop2();
-		nop2();
-//		nop2();
-		nop2();
-		__R30 = output_masked | color ; 		// 1 cycle
-		nop2();
-		nop2();
-		nop2();
-		nop2();
-		scanline++;								// 1 cycle
-		DO_SET(HUB75_CLK);   					// 1 cycle		
-	}
-	__delay_cycles(6);	
-	__R30 = output_masked;
-	
+/*
+	scanline shift kernels, see shift_kernel.asm. the pixel clock is
+	picked at runtime by ctrl.bitclock_khz: the fastest kernel that
+	isn't faster than asked for, or the slowest one.
+*/
+typedef void (*shift_fn)(volatile uint8_t *scanline, uint16_t scanlen);
+
+void shift_28(volatile uint8_t *scanline, uint16_t scanlen);
+void shift_25(volatile uint8_t *scanline, uint16_t scanlen);
+void shift_20(volatile uint8_t *scanline, uint16_t scanlen);
+
+static const struct {
+	uint32_t khz;
+	shift_fn shift;
+} shift_kernels[] = {	// fastest first
+	{ 28571, shift_28 },
+	{ 25000, shift_25 },
+	{ 20000, shift_20 },
+};
+
+#define N_SHIFT_KERNELS (sizeof(shift_kernels) / sizeof(shift_kernels[0]))
+
+// the kernels shift 8 bytes an iteration
+#if (W_PANEL * H_PANEL / (N_LINES * 2)) % 8
+#error "scanlen must be a multiple of 8"
 #endif
 
-}
+static shift_fn shift_scanline = shift_25;
 
 /* 
 	what should be our delays? 
@@ -276,6 +274,9 @@ static void shift_scanline(volatile uint8_t *scanline, uint16_t scanlen) {
     frequency is say 20 MHz..  that's 10 cycles per output
     or 3200 cycles per color interval.. so.. works!
 
+	refresh_plan.h has the model main_loop really follows, checked
+	below for this profile. tools/hub75_plan runs it for others.
+
 
 */
 
@@ -287,15 +288,521 @@ static void shift_scanline(volatile uint8_t *scanline, uint16_t scanlen) {
 //volatile far struct shared_mem shared = { 0, 32 * 2 };
 
 #pragma DATA_SECTION(buffer, ".share_buff")
-volatile far uint8_t buffer[32*32*10];
+#define BUFFER_LEN (32*32*10)
+volatile far uint8_t buffer[BUFFER_LEN];
 uint16_t scanlen;
 
+#pragma DATA_SECTION(ctrl, ".share_ctrl")
+volatile far struct shared_ctrl ctrl;
+
 uint16_t load_test_pattern(volatile far uint8_t *shared);
+void scan_plane_flags(const uint8_t *buffer, uint16_t scanlen,
+		      volatile far uint8_t *flags);
+void frame_timing(volatile far struct frame_info *info, uint32_t color_min,
+		  uint32_t plane_overhead);
+
+#if N_LINES * N_BITS > PLANE_FLAGS_LEN
+#error "more planes than PLANE_FLAGS_LEN"
+#endif
+#if N_BITS > INFO_PLANES
+#error "more bits than INFO_PLANES"
+#endif
+#if BUFFER_LEN > SHARED_CTRL_OFFSET
+#error "the display buffer runs into the control block"
+#endif
 
+/*
+	the profile has to work with as many panels as the buffer holds,
+	at the slowest pixel clock (10 cycles, shift_20), see refresh_plan.h
+*/
+#define FULL_SCANLEN (BUFFER_LEN / (N_LINES * N_BITS))
+#if PLAN_SCANLEN(1, W_PANEL, H_PANEL, N_LINES) > FULL_SCANLEN
+#error "not even one panel fits the display buffer"
+#endif
+#if COLOR_MIN < PLAN_LSB_MIN
+#error "COLOR_MIN is too short for the on-time overrun, see PLAN_LSB_MIN"
+#endif
+#if PLAN_REFRESH(N_LINES, N_BITS, PLAN_BINARY_SUM(N_BITS, COLOR_MIN), \
+		 PLAN_PLANE_OVERHEAD(FULL_SCANLEN, 10UL, DIM_DELAY)) < REFRESH_MIN
+#error "a full buffer refreshes slower than REFRESH_MIN"
+#endif
+
+/*
+	cycle clock for frame timestamps.
+
+	the IEP counter is reset every color interval, so it can't be used.
+	the PRU CYCLE counter stops (doesn't wrap) at 2^32, so fold it into
+	ctrl.clock and restart it at every frame boundary. the clock itself
+	wraps every ~21 s, compare with PTS_DUE().
+*/
+#define CLOCK_RESTART_CYCLES 4 // cycles lost while the counter is stopped
+
+static void clock_start(void)
+{
+	PRU1_CTRL.CTRL_bit.CTR_EN = 0;
+	PRU1_CTRL.CYCLE = 0;
+	PRU1_CTRL.CTRL_bit.CTR_EN = 1;
+	ctrl.clock = 0;
+}
+
+static uint32_t clock_now(void)
+{
+	uint32_t cycles = PRU1_CTRL.CYCLE;
+	PRU1_CTRL.CTRL_bit.CTR_EN = 0;	// CYCLE only writable when stopped
+	PRU1_CTRL.CYCLE = 0;
+	PRU1_CTRL.CTRL_bit.CTR_EN = 1;
+	ctrl.clock += cycles + CLOCK_RESTART_CYCLES;
+	return ctrl.clock;
+}
+
+static void ctrl_init(void)
+{
+	uint8_t i;
+
+	ctrl.magic = 0;
+	ctrl.scanlen = scanlen;
+	ctrl.frame_size = N_LINES * N_BITS * scanlen;
+	ctrl.frame_count = 0;
+	// anything queued before we started is stale
+	ctrl.q_tail = ctrl.q_head;
+	ctrl.qstats.presented = 0;
+	ctrl.qstats.dropped = 0;
+	ctrl.qstats.jitter_last = 0;
+	ctrl.qstats.jitter_max = 0;
+	ctrl.qstats.jitter_sum = 0;
+	for (i = 0; i < FRAME_QUEUE_LEN; i++) {
+		ctrl.stamps[i].tag = 0;
+		ctrl.stamps[i].flip = 0;
+		ctrl.stamps[i].lit = 0;
+	}
+	ctrl.lock_mode = LOCK_FREE;
+	ctrl.locked = 0;
+	ctrl.lock_phase = 0;
+	ctrl.lock_corr = 0;
+	ctrl.lock_missed = 0;
+	ctrl.elide.zero = 0;
+	ctrl.elide.same = 0;
+	ctrl.elide.last_frame = 0;
+	ctrl.bitclock_khz = 0;
+	ctrl.bitclock_now = BITCLOCK_DEFAULT;
+	ctrl.lsb_want = 0;
+	ctrl.lsb_cycles = COLOR_MIN;
+	ctrl.shift_cycles = 0;
+	ctrl.perf.shifted = 0;
+	ctrl.perf.shift_sum = 0;
+	ctrl.perf.shift_max = 0;
+	ctrl.perf.missed = 0;
+	ctrl.trace.mode = TRACE_OFF;
+	ctrl.trace.seq = 0;
+#ifdef PRU_TRACE
+	ctrl.trace.built = 1;
+#else
+	ctrl.trace.built = 0;
+#endif
+	ctrl.trace.head = 0;
+	ctrl.trace.stopped = 0;
+}
+
+/*
+	event trace, see struct trace_ring. only with PRU_TRACE, otherwise
+	TRACE() is nothing and the loop is what it always was. a record is
+	~20 cycles, mostly the stores to shared RAM.
+*/
+#ifdef PRU_TRACE
+static uint8_t trace_on;
+static uint32_t trace_mode, trace_seq;
+static uint32_t trace_head, trace_left, trace_base;
+
+static void trace_put(uint16_t event, uint16_t arg)
+{
+	volatile far struct trace_rec *r;
+
+	if (!trace_on)
+		return;
+	r = &ctrl.trace.ring[trace_head & TRACE_MASK];
+	r->cycle = trace_base + PRU1_CTRL.CYCLE;
+	r->event = event;
+	r->arg = arg;
+	ctrl.trace.head = ++trace_head;
+	if (trace_left && --trace_left == 0) {
+		trace_on = 0;
+		ctrl.trace.stopped = trace_head;
+	}
+}
+
+/* TRACE_MISS: keep going for half the ring, then stop */
+static void trace_late(void)
+{
+	trace_put(TRACE_LATE, 0);
+	if (trace_on && trace_mode == TRACE_MISS && !trace_left)
+		trace_left = TRACE_LEN / 2;
+}
+
+/* the cycle counter was just restarted at now, and pick up the mode */
+static void trace_frame(uint32_t now)
+{
+	trace_base = now;
+	if (ctrl.trace.mode != trace_mode || ctrl.trace.seq != trace_seq) {
+		trace_mode = ctrl.trace.mode;
+		trace_seq = ctrl.trace.seq;
+		trace_on = (trace_mode != TRACE_OFF);
+		trace_left = 0;
+		ctrl.trace.stopped = 0;
+	}
+	trace_put(TRACE_FRAME, ctrl.frame_count);
+}
+
+#define TRACE(event, arg)	trace_put(event, arg)
+#else
+#define TRACE(event, arg)
+#define trace_frame(now)
+#endif
+
+/* 32 byte struct copies compile to LBBO/SBBO bursts */
+struct burst {
+	uint32_t w[8];
+};
+
+static void copy_bursts(far struct burst *dst, far struct burst *src,
+			uint16_t n)
+{
+	while (n--)
+		*dst++ = *src++;
+}
+
+/* a global (L3) address, the host build maps it to its DDR stand-in */
+#ifndef GLOBAL_ADDR
+#define GLOBAL_ADDR(addr)	((far void *) (addr))
+#endif
+
+static void copy_frame(uint32_t addr, uint16_t size)
+{
+	far struct burst *src = (far struct burst *) GLOBAL_ADDR(addr);
+	uint16_t n = FRAME_PLANES_SIZE(size) / sizeof(struct burst);
+
+	// buffer is a multiple of 32 bytes, so rounding up is safe
+	copy_bursts((far struct burst *) buffer, src, n);
+	// the frame info trails the planes
+	copy_bursts((far struct burst *) &ctrl.info, src + n,
+		    FRAME_INFO_LEN / sizeof(struct burst));
+}
+
+/*
+	load the timing set of the displayed frame into the bit timers,
+	CMP0 .. CMP(planes - 1). only call with no bit timer running.
+*/
+static uint8_t planes = N_BITS;
+static uint32_t color_min = COLOR_MIN;	// LSB in use, see lsb_pick()
+
+static void timing_load(void)
+{
+	volatile uint32_t *cmp = &CT_IEP.TMR_CMP0;
+	uint32_t t;
+	uint8_t bit;
+
+	planes = ctrl.info.planes;
+	if (planes == 0 || planes > N_BITS)
+		planes = N_BITS;
+	for (bit = 0; bit < planes; bit++) {
+		t = ctrl.info.plane_time[bit];
+		cmp[bit] = t ? t : color_min << bit;
+	}
+}
+
+/*
+	frame lock. the phase of the sync edge seen during the last frame
+	goes through the PI loop, and the resulting frame period correction
+	is spread over the N_LINES * planes DIM intervals of the next one.
+	the edge is only seen while we wait on the IEP, so it can be late
+	by up to one shift; the loop filters that out.
+	a frame with a different timing set changes the period in one step,
+	which the loop has to pull back in like any other phase error.
+*/
+#define LOCK_DIM_STEPS (N_LINES * N_BITS)
+#define LOCK_LIMIT     ((int32_t) (DIM_DELAY / 2) * LOCK_DIM_STEPS)
+
+static struct frame_lock lock;
+
+static void frame_lock_step(uint32_t period)
+{
+	int32_t corr, step;
+
+	if (lock_mode != ctrl.lock_mode) {
+		lock_mode = ctrl.lock_mode;
+		TRACE(TRACE_LOCK, lock_mode);
+		frame_lock_reset(&lock, LOCK_LIMIT);
+		sync_seen = 0;
+		CT_IEP.TMR_CMP5 = DIM_DELAY;
+		DO_CLR(HUB75_SYNC_OUT);
+	}
+
+	if (lock_mode == LOCK_MASTER) {
+		// high for the first half of the frame, see main_loop
+		DO_SET(HUB75_SYNC_OUT);
+		return;
+	}
+	if (lock_mode != LOCK_SLAVE)
+		return;
+
+	if (sync_seen) {
+		corr = frame_lock_update(&lock, sync_phase, period);
+	} else {
+		corr = frame_lock_hold(&lock);
+		ctrl.lock_missed++;
+	}
+	sync_seen = 0;
+
+	// fewer planes means fewer DIM intervals to spread it over
+	step = corr / (int32_t) (N_LINES * planes);
+	if (step > (int32_t) DIM_DELAY / 2)
+		step = DIM_DELAY / 2;
+	if (step < -(int32_t) DIM_DELAY / 2)
+		step = -(int32_t) DIM_DELAY / 2;
+	CT_IEP.TMR_CMP5 = DIM_DELAY + step;
+
+	ctrl.locked = frame_lock_locked(&lock);
+	ctrl.lock_phase = lock.phase_err;
+	ctrl.lock_corr = corr;
+}
+
+/* planes skipped this frame, see main_loop */
+static uint16_t planes_zero, planes_same;
+
+static void elide_stats_flush(void)
+{
+	ctrl.elide.zero += planes_zero;
+	ctrl.elide.same += planes_same;
+	ctrl.elide.last_frame = planes_zero + planes_same;
+	planes_zero = 0;
+	planes_same = 0;
+}
+
+/* shifts this frame, see main_loop. local RAM, ctrl is a bus access */
+static uint16_t planes_shifted;
+static uint32_t shift_sum, shift_max;
+
+static void perf_flush(void)
+{
+	ctrl.perf.shifted += planes_shifted;
+	ctrl.perf.shift_sum += shift_sum;
+	if (shift_max > ctrl.perf.shift_max)
+		ctrl.perf.shift_max = shift_max;
+	ctrl.perf.missed += waits_late;
+	planes_shifted = 0;
+	shift_sum = 0;
+	shift_max = 0;
+	waits_late = 0;
+}
+
+/* switch kernels between frames, when ctrl.bitclock_khz changes */
+static uint8_t shift_select(void)
+{
+	static uint32_t khz = BITCLOCK_DEFAULT;
+	uint32_t want = ctrl.bitclock_khz ? ctrl.bitclock_khz : BITCLOCK_DEFAULT;
+	uint8_t k;
+
+	if (want == khz)
+		return 0;
+	khz = want;
+	for (k = 0; k < N_SHIFT_KERNELS - 1; k++)
+		if (shift_kernels[k].khz <= want)
+			break;
+	shift_scanline = shift_kernels[k].shift;
+	ctrl.bitclock_now = shift_kernels[k].khz;
+	TRACE(TRACE_CLOCK, shift_kernels[k].khz);
+	return 1;
+}
+
+/*
+	LSB calibration. COLOR_MIN is only where we start: the shift of a
+	long chain takes many times the on-time of the low planes, and with
+	a fixed LSB most of a frame would be dark. so at boot and whenever
+	the pixel clock changes, time one shift on the cycle counter, and
+	take the shortest LSB that lights a line at least as long as it is
+	dark (shift, latch, DIM), as long as REFRESH_MIN allows. it never
+	goes below PLAN_LSB_MIN, which keeps the binary weights within 1/8
+	of a level. ctrl.lsb_want from the host wins over all that, but for
+	PLAN_LSB_MIN.
+
+	the shift goes in without a latch, so the lit outputs don't change.
+*/
+#define LSB_WEIGHTS ((1UL << N_BITS) - 1)
+#define LINE_BUDGET (PLAN_PRU_HZ / (REFRESH_MIN * N_LINES))
+
+static uint32_t lsb_want_seen;
+
+static void lsb_measure(void)
+{
+	uint32_t t0 = PRU1_CTRL.CYCLE;
+
+	shift_scanline(buffer, scanlen);
+	ctrl.shift_cycles = PRU1_CTRL.CYCLE - t0;
+}
+
+static uint32_t lsb_pick(void)
+{
+	uint32_t overhead = ctrl.shift_cycles + DIM_DELAY + PLAN_PLANE_FIXED;
+	uint32_t dead = N_BITS * overhead;
+	uint32_t lsb, most = 0;
+
+	lsb_want_seen = ctrl.lsb_want;
+	if (lsb_want_seen) {
+		lsb = lsb_want_seen;
+	} else {
+		lsb = PLAN_LSB_FIT(N_BITS, overhead);
+		if (LINE_BUDGET > dead)
+			most = (LINE_BUDGET - dead) / LSB_WEIGHTS;
+		if (lsb > most)
+			lsb = most;
+	}
+	if (lsb < PLAN_LSB_MIN)
+		lsb = PLAN_LSB_MIN;
+	return lsb;
+}
+
+/*
+	the boot frame's timing is ours to redo, a queued one brought its own.
+	the last plane of the frame is still lit, so this only picks the LSB,
+	returns 1 when the bit timers need it, see timing_reload().
+*/
+static uint8_t lsb_update(uint8_t clock_changed)
+{
+	uint32_t lsb;
+
+	if (clock_changed)
+		lsb_measure();
+	else if (ctrl.lsb_want == lsb_want_seen)
+		return 0;
+	lsb = lsb_pick();
+	if (lsb == color_min)
+		return 0;
+	color_min = lsb;
+	ctrl.lsb_cycles = lsb;
+	TRACE(TRACE_LSB, lsb > 0xffff ? 0xffff : lsb);
+	if (ctrl.qstats.presented == 0)
+		frame_timing(&ctrl.info, color_min, PLANE_OVERHEAD(scanlen));
+	return 1;
+}
+
+/*
+	a compare moved under a running interval can be below the count
+	already, and then it never hits. so wait for the plane that is
+	on, and load them with the panel dark, as a flip does.
+*/
+static void timing_reload(void)
+{
+	iep_timer_wait();
+	DO_SET(HUB75_OE);
+	timing_load();
+	// main_loop expects a timer running
+	iep_timer_start(DIM_TIMER);
+}
+
+/*
+	latency stamps, see struct frame_stamp. the flip is stamped when the
+	copy starts, the first plane that goes on after it stamps lit.
+*/
+static volatile far struct frame_stamp *lit_pending;
+
+static void stamp_flip(uint32_t now, uint32_t tag)
+{
+	volatile far struct frame_stamp *st =
+		&ctrl.stamps[ctrl.qstats.presented & FRAME_QUEUE_MASK];
+
+	st->tag = tag;
+	st->flip = now + PRU1_CTRL.CYCLE;
+	st->lit = 0;
+	lit_pending = st;
+}
+
+static void stamp_lit(void)
+{
+	uint32_t lit = ctrl.clock + PRU1_CTRL.CYCLE;
+
+	// 0 means not yet
+	lit_pending->lit = lit ? lit : 1;
+	lit_pending = 0;
+}
+
+/*
+	called at the top of every frame. present the oldest queued frame
+	whose pts has come, dropping any that were overtaken by a later one.
+	the copy from DDR takes ~100 us for a full buffer, so it is done
+	with the panel dark instead of stretching the last plane.
+*/
+static void frame_boundary(void)
+{
+	static uint32_t last;
+	uint32_t now = clock_now();
+	uint32_t head = ctrl.q_head;
+	uint32_t tail = ctrl.q_tail;
+	uint32_t jitter;
+	uint8_t reload;
+	volatile far struct frame_desc *desc;
+
+	ctrl.frame_count++;
+	trace_frame(now);
+	frame_lock_step(now - last);
+	last = now;
+	elide_stats_flush();
+	perf_flush();
+	reload = lsb_update(shift_select());
+
+	if (tail == head) {
+		if (reload)
+			timing_reload();
+		return;
+	}
+
+	while (tail + 1 != head &&
+	       PTS_DUE(ctrl.queue[(tail + 1) & FRAME_QUEUE_MASK].pts, now)) {
+		TRACE(TRACE_DROP, tail & FRAME_QUEUE_MASK);
+		tail++;
+		ctrl.qstats.dropped++;
+	}
+
+	desc = &ctrl.queue[tail & FRAME_QUEUE_MASK];
+	if (!PTS_DUE(desc->pts, now)) {
+		ctrl.q_tail = tail;
+		if (reload)
+			timing_reload();
+		return;
+	}
+
+	jitter = now - desc->pts;
+	ctrl.qstats.jitter_last = jitter;
+	ctrl.qstats.jitter_sum += jitter;
+	if (jitter > ctrl.qstats.jitter_max)
+		ctrl.qstats.jitter_max = jitter;
+
+	iep_timer_wait();
+	DO_SET(HUB75_OE);
+	TRACE(TRACE_FLIP, tail & FRAME_QUEUE_MASK);
+	stamp_flip(now, desc->tag);
+	copy_frame(desc->addr, ctrl.frame_size);
+	// a new LSB comes with this, it has the panel dark anyway
+	timing_load();
+	// main_loop expects a timer running
+	iep_timer_start(DIM_TIMER);
+
+	ctrl.qstats.presented++;
+	ctrl.q_tail = tail + 1;
+}
+
+/*
+	planes flagged by the encoder are skipped, which shortens the frame.
+	that would pull a locked wall around, so only when free running.
+
+	PLANE_ZERO: only turn off the previous plane when its time is up.
+	PLANE_SAME: the data is already in the latches, just run the on-time,
+	moving the address (with OE off) if the line changed.
+*/
 void main_loop(void)
 {
 	uint8_t *scanline;
-	uint8_t line, bit;
+	uint8_t line, bit, flags;
+	uint8_t elide, lit_line = N_LINES;
+	uint32_t t0;
 	
 	// start the timer... since the loop expects one running
 	iep_timer_start(3); 
@@ -304,11 +811,17 @@ void main_loop(void)
 	
 	DO_CLR(HUB75_LAT);
 	
+	clock_start();
+	ctrl.magic = SHARED_CTRL_MAGIC;
 	
 	while(1) {
+		frame_boundary();
+		elide = (lock_mode == LOCK_FREE);
 		// do all color bits for each line and then move on to next line
 				for (line = 0; line < N_LINES; line++) {
-					for (bit = 0; bit < N_BITS; bit++) {
+					if (line == N_LINES / 2)
+						DO_CLR(HUB75_SYNC_OUT);
+					for (bit = 0; bit < planes; bit++) {
 #if 0				
 				scanline = buffer + (line * N_BITS + bit) * scanlen ;
 				shift_scanline( scanline, scanlen );
@@ -326,20 +839,59 @@ void main_loop(void)
 				DO_CLR(HUB75_OE);
 #else
 				scanline = buffer + (line * N_BITS + bit) * scanlen ;
+				flags = elide ? ctrl.info.plane_flags[line * N_BITS + bit] : 0;
+				if (flags & PLANE_ZERO) {
+					iep_timer_wait();
+					DO_SET(HUB75_OE);
+					iep_timer_start(SKIP_TIMER);
+					TRACE(TRACE_SKIP, (line * N_BITS + bit) | flags << 8);
+					planes_zero++;
+					continue;
+				}
+				if (flags & PLANE_SAME) {
+					iep_timer_wait();
+					TRACE(TRACE_SKIP, (line * N_BITS + bit) | flags << 8);
+					if (line != lit_line) {
+						DO_SET(HUB75_OE);
+						set_line_output(line);
+						lit_line = line;
+						iep_timer_start(DIM_TIMER);
+						iep_timer_wait();
+					}
+					iep_timer_start(bit);
+					DO_CLR(HUB75_OE);
+					TRACE(TRACE_ON, line * N_BITS + bit);
+					if (lit_pending)
+						stamp_lit();
+					planes_same++;
+					continue;
+				}
 				iep_timer_wait();
 				DO_SET(HUB75_OE);
+				TRACE(TRACE_SHIFT, line * N_BITS + bit);
 				__delay_cycles(4);
+				t0 = PRU1_CTRL.CYCLE;
 				shift_scanline( scanline, scanlen );
+				t0 = PRU1_CTRL.CYCLE - t0;
+				shift_sum += t0;
+				if (t0 > shift_max)
+					shift_max = t0;
+				planes_shifted++;
 				__delay_cycles(40);
 				DO_SET(HUB75_LAT);
 				__delay_cycles(80);
 				DO_CLR(HUB75_LAT);
 				// nop2();
 				iep_timer_start(DIM_TIMER);
+				TRACE(TRACE_LATCH, line * N_BITS + bit);
 				set_line_output(line);
+				lit_line = line;
 				iep_timer_wait();
 				iep_timer_start(bit);
 				DO_CLR(HUB75_OE);
+				TRACE(TRACE_ON, line * N_BITS + bit);
+				if (lit_pending)
+					stamp_lit();
 #endif
 			
 			}
@@ -380,8 +932,17 @@ void main(void) {
 	DO_SET(HUB75_LAT);
 	
 	scanlen = load_test_pattern(buffer);
+	ctrl_init();
+	scan_plane_flags((uint8_t *) buffer, scanlen, ctrl.info.plane_flags);
+	// main_loop restarts the counter, it only has to run for this
+	PRU1_CTRL.CTRL_bit.CTR_EN = 1;
+	lsb_measure();
+	color_min = lsb_pick();
+	ctrl.lsb_cycles = color_min;
+	frame_timing(&ctrl.info, color_min, PLANE_OVERHEAD(scanlen));
 	
     iep_timer_config();
+	timing_load();
     //intc_config();
 	
 	main_loop();
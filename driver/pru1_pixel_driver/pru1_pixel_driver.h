@@ -0,0 +1,63 @@
+/*
+ * pru1_pixel_driver.h
+ *
+ * the pins and timing defaults of pru1_pixel_driver.c, for the firmware
+ * and for everything that models it: the host simulations (host/) and
+ * the planner (tools/hub75_plan).  a change here is seen by all of them.
+ */
+
+#ifndef PRU1_PIXEL_DRIVER_H
+#define PRU1_PIXEL_DRIVER_H
+
+#include "panel_wiring.h"
+
+#define PRU_IEP_EVT	7
+#define HOST_INT1	0x80000000
+
+#define HUB75_B    8 /* "P8.27"  pru1: pr1_pru1_pru_r30_8,  B   */
+#define HUB75_LAT 10 /* "P8.28"  pru1: pr1_pru1_pru_r30_10, LAT */
+#define HUB75_C    9 /* "P8.29"  pru1: pr1_pru1_pru_r30_9,  C   */
+#define HUB75_OE  11 /* "P8.30"  pru1: pr1_pru1_pru_r30_11, OE  */
+#define HUB75_CLK  6 /* "P8.39"  pru1: pr1_pru1_pru_r30_6,  CLK */
+#define HUB75_A    7 /* "P8.40"  pru1: pr1_pru1_pru_r30_7,  A   */
+#define HUB75_G2   4 /* "P8.41"  pru1: pr1_pru1_pru_r31_4,  G2  */
+#define HUB75_B2   5 /* "P8.42"  pru1: pr1_pru1_pru_r31_5,  B2  */
+#define HUB75_B1   2 /* "P8.43"  pru1: pr1_pru1_pru_r30_2,  B1  */
+#define HUB75_R2   3 /* "P8.44"  pru1: pr1_pru1_pru_r30_3,  R2  */
+#define HUB75_R1   0 /* "P8.45"  pru1: pr1_pru1_pru_r30_0,  R1  */
+#define HUB75_G1   1 /* "P8.46"  pru1: pr1_pru1_pru_r30_1,  G1  */
+
+// frame lock between walls, P8.20 is eMMC CMD so boot from SD to use it
+#define HUB75_SYNC_IN  16 /* "P9.26"  pru1: pr1_pru1_pru_r31_16, sync in  */
+#define HUB75_SYNC_OUT 13 /* "P8.20"  pru1: pr1_pru1_pru_r30_13, sync out */
+
+#define HUB75_DATA 0x3FUL  // the 6 colors, a byte of a plane as it is
+#define COLORMASK ~0x7FUL  // 6 colors + CLK
+
+// the line address is A B C, read back as (r30 >> HUB75_A) & 7
+#define LSMASK ~((1UL << HUB75_A) | (1UL << HUB75_B) | (1UL << HUB75_C))
+
+// IEP cycles: the LSB to start from (calibrated at run time, see
+// lsb_pick()), the dark DIM interval before each on-time and the short
+// wait after a skipped plane, and the compares that time them
+#define COLOR_MIN  100UL
+#define DIM_DELAY  1500UL
+#define DIM_TIMER  5
+#define SKIP_DELAY 10UL
+#define SKIP_TIMER 6
+
+// pixel clock until the host asks for another, kHz
+#define BITCLOCK_DEFAULT 25000
+
+// the frame the built-in test pattern fills, see test_pattern.c
+#ifndef W_FB
+#ifdef FB_64
+#define W_FB 64
+#define H_FB 64
+#else
+#define W_FB 32
+#define H_FB 32
+#endif
+#endif
+
+#endif /* PRU1_PIXEL_DRIVER_H */
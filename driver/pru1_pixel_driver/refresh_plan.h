@@ -0,0 +1,61 @@
+/*
+ * refresh_plan.h
+ *
+ * what a frame costs in PRU cycles, for the compile time checks in
+ * pru1_pixel_driver.c and the planner (tools/hub75_plan).  plain
+ * integer macros, so they work in #if.
+ *
+ * main_loop() shifts and latches a plane with the panel dark, waits the
+ * DIM interval and then runs the on-time, nothing overlaps:
+ *
+ *   plane   = on-time + DIM + scanlen * cycles a clock + PLAN_PLANE_FIXED
+ *   frame   = lines * (sum of the on-times + planes * the rest)
+ *   refresh = PLAN_PRU_HZ / frame
+ *
+ * that is the worst case, planes skipped as black or already latched
+ * only make a frame shorter.  PLAN_PLANE_FIXED is the 4 + 40 + 80 cycles
+ * of delays around the shift, the kernel's entry and exit and the timer
+ * handling, as host/pru_bench measures it.
+ */
+
+#ifndef REFRESH_PLAN_H
+#define REFRESH_PLAN_H
+
+#define PLAN_PRU_HZ		200000000UL
+#define PLAN_PLANE_FIXED	160UL
+
+/*
+ * every on-time runs this many cycles long (the IEP wait and OE write,
+ * see host/wave_sim), the LSB has to be 8 times that to keep the error
+ * under 1/8 of a level.
+ */
+#define PLAN_ON_OVERRUN		10UL
+#define PLAN_LSB_MIN		(8 * PLAN_ON_OVERRUN)
+
+/* bytes a plane line takes for a chain of panels */
+#define PLAN_SCANLEN(panels, w, h, lines)	((panels) * (w) * (h) / ((lines) * 2))
+
+/* the display buffer holds every plane of every line */
+#define PLAN_BUFFER_BYTES(scanlen, lines, planes) \
+	(1UL * (lines) * (planes) * (scanlen))
+
+/* cycles of a plane besides its on-time */
+#define PLAN_PLANE_OVERHEAD(scanlen, clk, dim) \
+	((dim) + 1UL * (scanlen) * (clk) + PLAN_PLANE_FIXED)
+
+/* on-times of a binary table, 1, 2, 4 .. times the LSB */
+#define PLAN_BINARY_SUM(bits, lsb)	(((1UL << (bits)) - 1) * (lsb))
+
+/* the LSB that lights a line as long as it is dark, what the firmware
+   calibrates to (lsb_pick() in pru1_pixel_driver.c) */
+#define PLAN_LSB_FIT(bits, overhead) \
+	(((bits) * (overhead) + PLAN_BINARY_SUM(bits, 1) - 1) / \
+	 PLAN_BINARY_SUM(bits, 1))
+
+#define PLAN_FRAME(lines, planes, on_sum, overhead) \
+	(1UL * (lines) * ((on_sum) + (planes) * (overhead)))
+
+#define PLAN_REFRESH(lines, planes, on_sum, overhead) \
+	(PLAN_PRU_HZ / PLAN_FRAME(lines, planes, on_sum, overhead))
+
+#endif /* REFRESH_PLAN_H */
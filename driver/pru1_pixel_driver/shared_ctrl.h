@@ -0,0 +1,224 @@
+/*
+ * shared_ctrl.h
+ *
+ * layout of the control block that lives at the top of the PRU shared
+ * RAM, just after the display buffer.  this header is included by the
+ * PRU firmware and by the userspace tools in ../tools so keep it to
+ * plain fixed width types.
+ *
+ * the block is written by both sides, so every field has one owner:
+ *   (host) only written by the ARM side
+ *   (pru)  only written by the firmware
+ */
+
+#ifndef SHARED_CTRL_H
+#define SHARED_CTRL_H
+
+#include <stdint.h>
+
+#define SHARED_CTRL_MAGIC	0x43353748UL	/* "H75C" in memory */
+
+/* where the block is, as seen from the ARM (see AM335x_PRU.cmd) */
+#define PRUSS_SHARED_RAM_PHYS	0x4A310000UL
+#define SHARED_CTRL_OFFSET	0x2800UL
+#define SHARED_CTRL_SIZE	0x0800UL
+
+/*
+ * frame queue
+ *
+ * a single producer (host) / single consumer (pru) ring of encoded frames.
+ * the frames themselves live in DDR (there is no room for a second frame
+ * in shared RAM), the ring only carries their address and the time they
+ * should go up.  head and tail are free running, slot = index & MASK.
+ *
+ * the host fills queue[head & MASK] and then bumps head.  at every frame
+ * boundary the pru presents the oldest frame whose pts has come, copying
+ * it into the display buffer.  a frame that is still queued when the one
+ * after it is also due would never be seen, so it is dropped.
+ */
+#define FRAME_QUEUE_LEN		8	/* must be a power of 2 */
+#define FRAME_QUEUE_MASK	(FRAME_QUEUE_LEN - 1)
+
+/* wrap safe "has pts come yet" on the 32 bit cycle clock */
+#define PTS_DUE(pts, now)	((int32_t)((uint32_t)(now) - (uint32_t)(pts)) >= 0)
+
+/* a queue slot: the planes, rounded to the PRU copy burst, then info */
+#define FRAME_PLANES_SIZE(size)	(((size) + 31UL) & ~31UL)
+#define FRAME_SLOT_SIZE(size)	(FRAME_PLANES_SIZE(size) + FRAME_INFO_LEN)
+
+struct frame_desc {
+	uint32_t addr;		/* global address of the encoded frame */
+	uint32_t pts;		/* presentation time, PRU cycles */
+	uint32_t tag;		/* the producer's, comes back in frame_stamp */
+};
+
+/*
+ * when a presented frame went up, in stamps[presented & MASK] of the
+ * frame it was presented as (before qstats.presented counts it).  lit
+ * stays 0 until the first plane of the frame is on, flip is when the
+ * copy started.  both on the cycle clock.
+ */
+struct frame_stamp {
+	uint32_t tag;
+	uint32_t flip;
+	uint32_t lit;
+};
+
+struct queue_stats {
+	uint32_t presented;	/* frames copied to the display */
+	uint32_t dropped;	/* frames skipped because they were late */
+	uint32_t jitter_last;	/* cycles between pts and the frame boundary */
+	uint32_t jitter_max;
+	uint32_t jitter_sum;	/* wraps, use differences between samples */
+};
+
+/*
+ * frame info
+ *
+ * what the encoder knows about a frame that the display loop needs.  the
+ * encoder fills it in and a queued frame carries it in a FRAME_INFO_LEN
+ * trailer after its planes.  all zero is always safe and means a plain
+ * N_BITS binary frame with nothing to skip.
+ *
+ * plane_flags has one byte per plane, in display order
+ * (line * N_BITS + bit), telling the display loop which planes it can skip.
+ *
+ * planes and plane_time are the timing set.  the encoder picks the
+ * fewest planes that show every level the frame uses, either binary
+ * (plane_time doubling) or one plane per level (plane_time = the level),
+ * and only the first `planes` planes of each line are shown.  the rest
+ * stay in the layout and must be black.
+ *
+ * est_ma, peak_ma and scale come from the current limiter: the encoder
+ * counts the LEDs lit in every plane, estimates the average current of
+ * the frame and, when that is over budget, scales all the on-times down
+ * by scale / 256.  0 when the encoder didn't say.
+ */
+#define PLANE_FLAGS_LEN		64
+#define PLANE_ZERO		0x01	/* nothing lit, skip the whole plane */
+#define PLANE_SAME		0x02	/* same as the data latched before it,
+					   skip the shift and latch */
+
+#define INFO_PLANES		8	/* plane_time entries */
+#define FRAME_INFO_LEN		128	/* multiple of the PRU copy burst */
+
+struct frame_info {
+	uint8_t plane_flags[PLANE_FLAGS_LEN];
+	uint8_t planes;		/* planes shown per line, 0 for N_BITS */
+	uint8_t reserved[3];
+	uint32_t plane_time[INFO_PLANES];	/* on-time, cycles, 0 for
+						   the binary default */
+	uint16_t est_ma;	/* average current before limiting */
+	uint16_t peak_ma;	/* current of the brightest plane */
+	uint16_t scale;		/* on-time scale applied, 256 for none */
+	uint16_t reserved2;
+	uint8_t pad[FRAME_INFO_LEN - PLANE_FLAGS_LEN - 4 - 4 * INFO_PLANES - 8];
+};
+
+struct elide_stats {
+	uint32_t zero;		/* planes skipped because they were black */
+	uint32_t same;		/* shifts skipped because the data was latched */
+	uint32_t last_frame;	/* planes skipped in the last frame */
+};
+
+/*
+ * what main_loop spends, kept on the PRU and added in once a frame.
+ * frames displayed are frame_count, flips and drops are in qstats.
+ */
+struct perf_stats {
+	uint32_t shifted;	/* planes shifted and latched */
+	uint32_t shift_sum;	/* cycles shifting, wraps, use differences */
+	uint32_t shift_max;	/* longest shift, cycles */
+	uint32_t missed;	/* timer waits entered late, the interval
+				   (on-time, DIM) ran long */
+};
+
+/*
+ * event trace
+ *
+ * only in a firmware built with PRU_TRACE (make TRACE=1), anywhere else
+ * built stays 0 and nothing is ever written.  records go into ring[head
+ * & TRACE_MASK] before head is bumped, head is free running.  cycle is
+ * on the same clock as ctrl.clock and pts.
+ *
+ * mode is picked up at the next frame boundary.  TRACE_RUN overwrites
+ * the ring for good, TRACE_MISS stops TRACE_LEN / 2 records after a
+ * missed deadline (see perf_stats), so the ring holds what led up to it
+ * and what followed.  stopped is then the head it stopped at.  bump seq
+ * to rearm it.
+ */
+#define TRACE_LEN		128	/* must be a power of 2 */
+#define TRACE_MASK		(TRACE_LEN - 1)
+
+#define TRACE_OFF		0
+#define TRACE_RUN		1
+#define TRACE_MISS		2
+
+/* events, arg is a plane (line * N_BITS + bit) unless it says otherwise */
+#define TRACE_FRAME		1	/* frame boundary, arg frame_count */
+#define TRACE_SHIFT		2	/* previous plane off, shift starts */
+#define TRACE_LATCH		3	/* latched, DIM interval starts */
+#define TRACE_ON		4	/* on-time starts */
+#define TRACE_SKIP		5	/* previous plane off, plane skipped,
+					   arg plane | its flags << 8 */
+#define TRACE_LATE		6	/* missed deadline, arg 0 */
+#define TRACE_FLIP		7	/* queued frame copied, arg queue slot */
+#define TRACE_DROP		8	/* queued frame dropped, arg queue slot */
+#define TRACE_CLOCK		9	/* pixel clock changed, arg kHz */
+#define TRACE_LSB		10	/* LSB changed, arg cycles (max 0xffff) */
+#define TRACE_LOCK		11	/* lock mode changed, arg the mode */
+
+struct trace_rec {
+	uint32_t cycle;
+	uint16_t event;
+	uint16_t arg;
+};
+
+struct trace_ring {
+	uint32_t mode;		/* (host) TRACE_OFF, TRACE_RUN or TRACE_MISS */
+	uint32_t seq;		/* (host) bump to restart */
+	uint32_t built;		/* (pru)  1 if the firmware can trace */
+	uint32_t head;		/* (pru)  records written */
+	uint32_t stopped;	/* (pru)  head it stopped at, 0 while running */
+	struct trace_rec ring[TRACE_LEN];	/* (pru) */
+};
+
+struct shared_ctrl {
+	uint32_t magic;		/* (pru) SHARED_CTRL_MAGIC once running */
+	uint16_t scanlen;	/* (pru) bytes per plane of a scanline */
+	uint16_t frame_size;	/* (pru) bytes per encoded frame */
+	uint32_t clock;		/* (pru) cycle clock at the last frame boundary */
+	uint32_t frame_count;	/* (pru) frame boundaries passed */
+
+	uint32_t q_head;	/* (host) next slot to fill */
+	uint32_t q_tail;	/* (pru)  next slot to present */
+	struct frame_desc queue[FRAME_QUEUE_LEN];	/* (host) */
+	struct queue_stats qstats;			/* (pru) */
+	struct frame_stamp stamps[FRAME_QUEUE_LEN];	/* (pru) */
+
+	/* frame lock, see frame_lock.h */
+	uint32_t lock_mode;	/* (host) LOCK_FREE, LOCK_SLAVE or LOCK_MASTER */
+	uint32_t locked;	/* (pru) phase inside the lock window */
+	int32_t lock_phase;	/* (pru) last phase error, cycles */
+	int32_t lock_corr;	/* (pru) frame period correction, cycles */
+	uint32_t lock_missed;	/* (pru) frames without a sync edge */
+
+	/* of the displayed frame, plane_flags only used when free running */
+	struct frame_info info;			/* (pru) */
+	struct elide_stats elide;		/* (pru) */
+
+	/* pixel clock, see shift_kernel.asm */
+	uint32_t bitclock_khz;	/* (host) wanted, 0 for the default */
+	uint32_t bitclock_now;	/* (pru)  kHz of the kernel in use */
+
+	/* LSB on-time, calibrated against the shift at boot and on every
+	   pixel clock change unless the host asks for one */
+	uint32_t lsb_want;	/* (host) cycles, 0 to calibrate */
+	uint32_t lsb_cycles;	/* (pru)  cycles in use */
+	uint32_t shift_cycles;	/* (pru)  measured shift of a scanline */
+
+	struct perf_stats perf;			/* (pru) */
+	struct trace_ring trace;
+};
+
+#endif /* SHARED_CTRL_H */
@@ -0,0 +1,105 @@
+;
+; shift_kernel.asm
+;
+; hand scheduled scanline shift, one kernel per pixel clock.
+;
+;   void shift_NN(volatile uint8_t *scanline, uint16_t scanlen);
+;
+; the C loop it replaces loaded a byte (3 cycles) every clock and had
+; nop()s tuned per BITCLOCK.  here the data comes in a 32 bit word (4
+; clocks) per LBBO, into two registers that take turns, and each load
+; hides in a CLK high half that is long enough for it.  every clock is
+;
+;   OR  R30, R0, Rn.bm     data out and CLK low     lo cycles
+;   SET R30, R30, CLK      CLK high, panel samples  hi cycles
+;
+; with the padding (and the work) filling the rest of each half, so the
+; edges are evenly spaced whatever is going on in the loop:
+;
+;   kernel    lo  hi  cycles  clock      high half work
+;   shift_28   3   4    7     28.6 MHz   clock 0: LBBO next word (3)
+;   shift_25   4   4    8     25.0 MHz   clock 4: LBBO next word (3)
+;   shift_20   5   5   10     20.0 MHz   clock 5: ADD pointer (1)
+;
+; the loop is a hardware LOOP (no cycles to branch back) over 8 clocks,
+; so hi >= 4 and lo >= 1 are all it needs.  the panels want CLK low
+; for 15 ns (3 cycles) as well, see host/wave_sim, so 7 cycles is the
+; fastest clock.  the load of a word takes 3 cycles from shared RAM, so
+; is only issued after the OR that used the register last.  the last
+; iteration reads a word past the scanline, which is harmless.
+;
+; `make proof` times the edges in the dispru listing of the linked
+; firmware (see host/clkproof.awk), it should print the table above.
+;
+; scanlen must be a multiple of 8, pru1_pixel_driver.c checks that.
+; only R0, R14, R15, R20, R21 and R29 are used, all save-on-call.
+;
+
+CLK	.set	6		; HUB75_CLK in pru1_pixel_driver.c
+
+; n cycles of nothing
+PAD	.macro	n
+	.if	n > 0
+	.loop	n
+	MOV	R29, R29
+	.endloop
+	.endif
+	.endm
+
+; one clock of the data in byte
+CLOCK	.macro	byte, lo, hi
+	OR	R30, R0, byte
+	PAD	lo-1
+	SET	R30, R30, CLK
+	PAD	hi-1
+	.endm
+
+SHIFT_KERNEL .macro lo, hi
+	LDI	R0.w0, 0xFF80		; R0 = R30 & COLORMASK
+	LDI	R0.w2, 0xFFFF
+	AND	R0, R30, R0
+	LSR	R15, R15.w0, 3		; 8 clocks an iteration
+	QBEQ	done?, R15, 0
+	LBBO	&R20, R14, 0, 4		; first word
+	LOOP	loop_end?, R15.w0
+
+	OR	R30, R0, R20.b0		; clock 0
+	PAD	lo-1
+	SET	R30, R30, CLK
+	LBBO	&R21, R14, 4, 4		; second word, for clock 4
+	PAD	hi-4
+	CLOCK	R20.b1, lo, hi
+	CLOCK	R20.b2, lo, hi
+	CLOCK	R20.b3, lo, hi
+
+	OR	R30, R0, R21.b0		; clock 4
+	PAD	lo-1
+	SET	R30, R30, CLK
+	LBBO	&R20, R14, 8, 4		; first word of the next iteration
+	PAD	hi-4
+	OR	R30, R0, R21.b1		; clock 5
+	PAD	lo-1
+	SET	R30, R30, CLK
+	ADD	R14, R14, 8
+	PAD	hi-2
+	CLOCK	R21.b2, lo, hi
+	CLOCK	R21.b3, lo, hi
+loop_end?:
+	MOV	R30, R0			; data and CLK low
+done?:
+	JMP	R3.w2
+	.endm
+
+	.text
+
+	.global	shift_28
+shift_28:
+	SHIFT_KERNEL 3, 4
+
+	.global	shift_25
+shift_25:
+	SHIFT_KERNEL 4, 4
+
+	.global	shift_20
+shift_20:
+	SHIFT_KERNEL 5, 5
@@ -2,10 +2,14 @@
 
 #include <stdint.h>
 #include "panel_wiring.h"
+#include "shared_ctrl.h"
+#include "pru1_pixel_driver.h"
 
+// the images are W_ASSET x H_ASSET. the frame is W_FB x H_FB, the same
+// unless the build sets another (host/encode_check.c)
 #ifdef FB_64
-#define W_FB 64
-#define H_FB 64
+#define W_ASSET 64
+#define H_ASSET 64
 #pragma DATA_SECTION(framed_rainbow, ".other_dram")
 static uint16_t framed_rainbow[] = {
     0xe71c, 0xf79e, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xef7d, 0xf79e, 0xe71c, 
@@ -283,8 +287,8 @@ static uint8_t cool_guy_data[] = {
     ,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00
 };
 
-#define W_FB 32
-#define H_FB 32
+#define W_ASSET 32
+#define H_ASSET 32
 #endif
 
 
@@ -332,10 +336,28 @@ static const uint16_t line_pattern[] = {
 static const uint32_t column_pattern = 
 	 0b10110011100011110000000011111111;
 
+#ifdef FB_64
+static const struct {
+	const char *name;
+	uint16_t *image;
+} assets[] = {
+	{ "framed_rainbow", framed_rainbow },
+	{ "cool_guy_data", cool_guy_data },
+	{ "coke_bottle", coke_bottle },
+};
 //static uint16_t *fb = (uint16_t *) cool_guy_data;
-//static uint16_t *fb = (uint16_t *) test_pattern_data;
 static uint16_t *fb = (uint16_t *) framed_rainbow;
 //static uint16_t *fb = (uint16_t *) coke_bottle;
+#else
+static const struct {
+	const char *name;
+	uint16_t *image;
+} assets[] = {
+	{ "test_pattern_data", (uint16_t *) test_pattern_data },
+	{ "cool_guy_data", (uint16_t *) cool_guy_data },
+};
+static uint16_t *fb = (uint16_t *) test_pattern_data;
+#endif
 
 static inline uint16_t swap16 (uint16_t a) {
 	 a = ((a & 0x00FF) << 8) | ((a & 0xFF00) >> 8);
@@ -361,6 +383,30 @@ static uint16_t *get_frame_buffer(void)
 	return fb;
 }
 
+// the image load_test_pattern() encodes, W_FB x H_FB RGB565, for the
+// host side checks (host/light_sim.c)
+const uint16_t *test_pattern_image(void)
+{
+	return fb;
+}
+
+// the next load_test_pattern() encodes image, W_FB x H_FB RGB565
+void test_pattern_use(const uint16_t *image)
+{
+	fb = (uint16_t *) image;
+}
+
+// built in image i and its name, NULL past the last one or when the
+// frame isn't the size of the images
+const uint16_t *test_pattern_asset(unsigned int i, const char **name)
+{
+	if (W_FB != W_ASSET || H_FB != H_ASSET ||
+	    i >= sizeof(assets) / sizeof(assets[0]))
+		return 0;
+	*name = assets[i].name;
+	return assets[i].image;
+}
+
 #if 0
 uint16_t load_test_pattern(volatile far uint8_t *buffer)
 {
@@ -410,19 +456,48 @@ uint16_t load_test_pattern(volatile far uint8_t *buffer)
 //#define B_LEN 8
 //#define B_LEN 16
 
-uint16_t load_test_pattern(uint8_t *buffer)
+// adaptive bit depth.
+// every level each channel uses is noted while encoding. a frame with
+// only a few levels (text, flat colours) can show them in fewer planes
+// than N_BITS, either binary up to the highest level used, or one plane
+// per level with the level as its on-time. the planes go through
+// level_planes[] (level -> planes lit), so the first pass is plain
+// binary and a second pass only runs when one plane per level wins.
+#define N_LEVELS   (1U << N_BITS)
+#define LEVEL_MASK (N_LEVELS - 1)
+
+#if N_LEVELS > 32
+#error "levels_used[] holds a bit per level"
+#endif
+
+static uint8_t level_planes[N_LEVELS];
+static uint32_t levels_used[3];		// R, G, B
+static uint8_t n_planes = N_BITS;
+static uint8_t plane_weight[N_BITS];	// in units of the LSB time
+
+// LEDs lit per plane, (line * N_BITS + bit), for the current limiter
+static uint16_t plane_lit[N_LINES * N_BITS];
+
+static const uint8_t bits_set[64] = {
+	0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+};
+
+static uint16_t encode_planes(uint8_t *buffer)
 {
     // loop variables
     unsigned int line, i, bit, ix, np, mp, N0, M0, z, p;
     // 8 bit colors
 	uint8_t color, RU, GU, BU, RL, GL, BL, BM;
+	uint8_t rU, gU, bU, rL, gL, bL;
+	uint32_t used_r = 0, used_g = 0, used_b = 0;
     uint16_t scanlen;
 	uint16_t colorU[B_LEN], colorL[B_LEN];
 	uint8_t *scanline;
+	uint16_t *lit;
 
-	fb = get_frame_buffer();
-	//uint16_t *fb = (uint16_t *) cool_guy_data;
-	
 	scanlen = W_FB * H_FB / (N_LINES * 2);
 			
 	for(line=0; line < N_LINES; line++) {
@@ -430,6 +505,9 @@ uint16_t load_test_pattern(uint8_t *buffer)
 		// now we need to go over the actual image        
 		z = 0;
 		scanline = buffer + line * N_BITS * scanlen;
+		lit = plane_lit + line * N_BITS;
+		for (bit = 0; bit < N_BITS; bit++)
+			lit[bit] = 0;
 		
 		for (p = 0; p < (W_FB/W_PANEL)*(H_FB/H_PANEL); p++) {
 #ifdef V_LAYOUT
@@ -449,12 +527,21 @@ uint16_t load_test_pattern(uint8_t *buffer)
 				 
 					ix = z * B_LEN;
 	                for ( i = 0; i < B_LEN; i++) {
-	    				RU = (colorU[i] >> (16-N_BITS) ) ;
-	    				GU = (colorU[i] >> (11-N_BITS) ) ;
-	    				BU = (colorU[i] >> ( 5-N_BITS) ) ;
-	    				RL = (colorL[i] >> (16-N_BITS) ) ;
-	    				GL = (colorL[i] >> (11-N_BITS) ) ;
-	    				BL = (colorL[i] >> ( 5-N_BITS) ) ;
+	    				rU = (colorU[i] >> (16-N_BITS) ) & LEVEL_MASK;
+	    				gU = (colorU[i] >> (11-N_BITS) ) & LEVEL_MASK;
+	    				bU = (colorU[i] >> ( 5-N_BITS) ) & LEVEL_MASK;
+	    				rL = (colorL[i] >> (16-N_BITS) ) & LEVEL_MASK;
+	    				gL = (colorL[i] >> (11-N_BITS) ) & LEVEL_MASK;
+	    				bL = (colorL[i] >> ( 5-N_BITS) ) & LEVEL_MASK;
+	    				used_r |= (1UL << rU) | (1UL << rL);
+	    				used_g |= (1UL << gU) | (1UL << gL);
+	    				used_b |= (1UL << bU) | (1UL << bL);
+	    				RU = level_planes[rU];
+	    				GU = level_planes[gU];
+	    				BU = level_planes[bU];
+	    				RL = level_planes[rL];
+	    				GL = level_planes[gL];
+	    				BL = level_planes[bL];
 	    				for (bit = 0; bit < N_BITS; bit++) {
 	    					BM = 1U << bit;
 	    					color = 0;
@@ -465,6 +552,7 @@ uint16_t load_test_pattern(uint8_t *buffer)
 	    					if ((GL & BM) != 0) color |= G2_VAL;
 	    					if ((BL & BM) != 0) color |= B2_VAL;
 	    					scanline[ ix + bit * scanlen] = color;
+	    					lit[bit] += bits_set[color];
 	    				}
 						ix++;
 	                }
@@ -472,8 +560,165 @@ uint16_t load_test_pattern(uint8_t *buffer)
             }
 		}
 	}
+	levels_used[0] = used_r;
+	levels_used[1] = used_g;
+	levels_used[2] = used_b;
+    return scanlen;
+}
+
+// pick the fewest planes that show every level in use. returns 1 when
+// that is one plane per level and level_planes[] has been remapped.
+static uint8_t choose_planes(void)
+{
+	uint32_t used = (levels_used[0] | levels_used[1] | levels_used[2]) & ~1UL;
+	unsigned int level, binary = 0, distinct = 0;
+
+	for (level = 1; level < N_LEVELS; level++) {
+		if (used & (1UL << level)) {
+			distinct++;
+			while ((level >> binary) != 0)
+				binary++;
+		}
+	}
+
+	if (distinct < binary) {
+		n_planes = 0;
+		for (level = 0; level < N_LEVELS; level++) {
+			level_planes[level] = 0;
+			if (used & (1UL << level)) {
+				level_planes[level] = 1U << n_planes;
+				plane_weight[n_planes++] = level;
+			}
+		}
+		return 1;
+	}
+	// an all black frame still shows one (black) plane
+	n_planes = binary ? binary : 1;
+	return 0;
+}
+
+uint16_t load_test_pattern(uint8_t *buffer)
+{
+	unsigned int level, bit;
+	uint16_t scanlen;
+
+	fb = get_frame_buffer();
+	//uint16_t *fb = (uint16_t *) cool_guy_data;
+
+	for (level = 0; level < N_LEVELS; level++)
+		level_planes[level] = level;
+	for (bit = 0; bit < N_BITS; bit++)
+		plane_weight[bit] = 1U << bit;
+
+	scanlen = encode_planes(buffer);
+	if (choose_planes())
+		encode_planes(buffer);
     return scanlen;
 }
 #endif
 
+// current limiter.
+// a lit LED draws LED_UA while its plane is on, so over a frame
+//   avg = LED_UA * Q / (S + P)
+// with Q the sum of lit * on-time over all planes, S the total on-time
+// and P the total overhead (shift, DIM). scaling every on-time by k
+// gives LED_UA * k * Q / (k * S + P), which is solved for LIMIT_MA.
+// returns k * 256.
+// only the planes main_loop runs count, by the flags in info: a
+// PLANE_ZERO plane is skipped, a PLANE_SAME one isn't shifted. a
+// locked wall shows them all, which only makes the frame longer.
+static uint16_t current_limit(const uint32_t *t, uint32_t plane_overhead,
+			      volatile far struct frame_info *info)
+{
+	uint64_t q = 0, s = 0, p, over;
+	uint32_t avg, peak = 0, budget = LIMIT_MA * 1000UL;
+	unsigned int line, bit, shifted = 0;
+	uint16_t n, scale;
+	uint8_t flags;
+
+	for (line = 0; line < N_LINES; line++) {
+		for (bit = 0; bit < n_planes; bit++) {
+			flags = info->plane_flags[line * N_BITS + bit];
+			if (flags & PLANE_ZERO)
+				continue;
+			if (!(flags & PLANE_SAME))
+				shifted++;
+			n = plane_lit[line * N_BITS + bit];
+			q += (uint64_t) n * t[bit];
+			s += t[bit];
+			if (n > peak)
+				peak = n;
+		}
+	}
+	p = (uint64_t) shifted * plane_overhead;
+
+	// an all black frame runs no plane at all
+	avg = (s + p) ? LED_UA * q / (s + p) : 0;
+	peak = peak * LED_UA / 1000;
+	info->est_ma = (avg / 1000 > 0xFFFF) ? 0xFFFF : avg / 1000;
+	info->peak_ma = (peak > 0xFFFF) ? 0xFFFF : peak;
+
+	if (budget == 0 || avg <= budget)
+		return 256;
+	over = LED_UA * q - (uint64_t) budget * s;
+	scale = (uint64_t) budget * p * 256 / over;
+	return scale ? scale : 1;
+}
+
+// publish the timing set picked for the last encoded frame, with the
+// on-times scaled down if the frame would draw more than LIMIT_MA.
+// info->plane_flags has to be set first, see scan_plane_flags().
+void frame_timing(volatile far struct frame_info *info, uint32_t color_min,
+		  uint32_t plane_overhead)
+{
+	uint32_t t[N_BITS];
+	unsigned int p;
+	uint16_t scale;
+
+	for (p = 0; p < n_planes; p++)
+		t[p] = plane_weight[p] * color_min;
+	scale = current_limit(t, plane_overhead, info);
+
+	info->planes = n_planes;
+	info->scale = scale;
+	for (p = 0; p < INFO_PLANES; p++) {
+		if (p >= n_planes)
+			info->plane_time[p] = 0;
+		else if (scale == 256)
+			info->plane_time[p] = t[p];
+		else	// 0 would mean the default, so never below a cycle
+			info->plane_time[p] = (t[p] * scale >> 8) + 1;
+	}
+}
+
+// flag the planes main_loop can skip, in display order.
+// PLANE_SAME compares against the last plane that was actually shifted,
+// the first lit plane of a frame is always shifted.
+void scan_plane_flags(const uint8_t *buffer, uint16_t scanlen,
+		      volatile far uint8_t *flags)
+{
+	const uint8_t *plane, *latched = 0;
+	unsigned int p, i;
+	uint8_t lit, diff;
+
+	for (p = 0; p < N_LINES * N_BITS; p++) {
+		plane = buffer + p * scanlen;
+		lit = 0;
+		diff = (latched == 0);
+		for (i = 0; i < scanlen; i++) {
+			lit |= plane[i];
+			if (latched)
+				diff |= plane[i] ^ latched[i];
+		}
+		if (!lit) {
+			flags[p] = PLANE_ZERO;
+		} else if (!diff) {
+			flags[p] = PLANE_SAME;
+		} else {
+			flags[p] = 0;
+			latched = plane;
+		}
+	}
+}
+
 //#ifdef TEST_PROGRAM
@@ -0,0 +1,56 @@
+/*
+ * hub75_clock.c
+ *
+ * set the pixel clock of the PRU driver and show the one in use.
+ *
+ *   hub75_clock [-m mem] [-l lsb] [khz]
+ *
+ * the firmware picks the fastest shift kernel that isn't faster than
+ * <khz> (28571, 25000 or 20000), 0 goes back to the default.
+ *
+ * the LSB on-time follows the shift time of the clock in use, unless
+ * -l sets one in PRU cycles (5 ns).  -l 0 goes back to calibrating.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pru_mem.h"
+
+int main(int argc, char **argv)
+{
+	const char *mem = PRU_MEM_DEFAULT;
+	volatile struct shared_ctrl *ctrl;
+	long lsb = -1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:l:")) != -1) {
+		switch (opt) {
+		case 'm': mem = optarg; break;
+		case 'l': lsb = strtol(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-m mem] [-l lsb] [khz]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	ctrl = pru_ctrl_map(mem);
+	if (!ctrl)
+		return 1;
+
+	if (optind < argc)
+		ctrl->bitclock_khz = strtoul(argv[optind], NULL, 0);
+	if (lsb >= 0)
+		ctrl->lsb_want = lsb;
+
+	printf("pixel clock %.1f MHz", ctrl->bitclock_now / 1000.0);
+	if (ctrl->bitclock_khz)
+		printf(", asked for %.1f MHz", ctrl->bitclock_khz / 1000.0);
+	printf("\nLSB %.3f us, %s\n", ctrl->lsb_cycles / 200.0,
+	       ctrl->lsb_want ? "set by the host" : "calibrated");
+
+	pru_ctrl_unmap(ctrl);
+	return 0;
+}
@@ -0,0 +1,356 @@
+/*
+ * hub75_latency.c
+ *
+ * producer to photon latency: queue frames like hub75_queue, each one
+ * stamped as it goes through the host side, and match them with the
+ * stamps the PRU leaves when it flips to a frame and lights its first
+ * plane (struct frame_stamp).
+ *
+ *   hub75_latency -a <ddr phys> [-m mem] [-d ddr] [-n frames]
+ *                 [-i usec] [-o file.csv] frame...
+ *
+ * the frame files are cycled through until -n frames went out, one
+ * every -i usec, each due as soon as it is queued.  the stages:
+ *
+ *   load     frame handed over until it is encoded.  the files are
+ *            encoded already, so this is reading one, an encoder in
+ *            the producer would go here.
+ *   upload   into the DDR slot and the queue
+ *   queue    until the PRU flipped to it, at the next frame boundary
+ *   light    flip until the first plane was on
+ *   total    handed over until lit
+ *
+ * -o writes every frame's stamps, us from the first hand over.  an all
+ * black frame never lights, it counts as not shown.
+ *
+ * the PRU stamps are on its cycle clock.  they are brought to the host
+ * clock through ctrl->clock, watched while waiting: every frame boundary
+ * seen is a point, the stamps are interpolated between them, so they
+ * are good to the poll interval.  that also works against host/pru_bench
+ * -m, which runs slower than real time and not even steadily, so this
+ * profiles the host side off-board too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pru_mem.h"
+
+#define POLL_USEC	100
+#define DRAIN_SECS	1.0
+
+struct frame_times {
+	double handed, loaded, uploaded;	/* host seconds */
+	uint32_t flip, lit;			/* cycle clock */
+	int shown;
+};
+
+/* cycle clock to host seconds, see above */
+struct clock_point {
+	double host;		/* seconds, when the change was seen */
+	uint64_t clock;		/* unwrapped */
+};
+
+struct clock_map {
+	uint32_t last;		/* ctrl->clock last seen */
+	uint32_t n, len;
+	struct clock_point *p;
+};
+
+static volatile struct shared_ctrl *ctrl;
+static struct clock_map map;
+
+static double host_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void clock_watch(void)
+{
+	uint32_t clock = ctrl->clock;
+	struct clock_point *p;
+
+	if (map.n && clock == map.last)
+		return;
+	if (map.n == map.len) {
+		map.len = map.len ? 2 * map.len : 1024;
+		map.p = realloc(map.p, map.len * sizeof(*map.p));
+		if (!map.p) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	p = &map.p[map.n];
+	p->host = host_secs();
+	p->clock = map.n ? p[-1].clock + (uint32_t)(clock - map.last) : clock;
+	map.last = clock;
+	map.n++;
+}
+
+/* cycles per host second, over the whole run */
+static double clock_rate(void)
+{
+	struct clock_point *a = map.p, *b = map.p + map.n - 1;
+
+	if (map.n < 2 || b->host <= a->host)
+		return PRU_CYCLES_PER_US * 1e6;
+	return (b->clock - a->clock) / (b->host - a->host);
+}
+
+static double clock_host(uint32_t cycle)
+{
+	struct clock_point *a, *b;
+	uint64_t c;
+	uint32_t lo = 0, hi;
+
+	if (!map.n)
+		return 0;
+	b = &map.p[map.n - 1];
+	c = b->clock + (int32_t)(cycle - map.last);
+
+	// the last point at or before c, the one after it
+	if (c <= map.p[0].clock || map.n < 2)
+		return map.p[0].host -
+		       (double)(map.p[0].clock - c) / clock_rate();
+	if (c >= b->clock)
+		return b->host + (double)(c - b->clock) / clock_rate();
+	hi = map.n - 1;
+	while (hi - lo > 1) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if (map.p[mid].clock <= c)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	a = &map.p[lo];
+	b = &map.p[hi];
+	return a->host + (b->host - a->host) *
+	       (double)(c - a->clock) / (b->clock - a->clock);
+}
+
+/* wait a while, keeping an eye on the clock */
+static void poll_for(double secs)
+{
+	double until = host_secs() + secs;
+
+	do {
+		clock_watch();
+		usleep(POLL_USEC);
+	} while (host_secs() < until);
+}
+
+/* match the stamps of frames presented since last time */
+static uint32_t collect(struct frame_times *ft, uint32_t n, uint32_t seen)
+{
+	uint32_t presented = ctrl->qstats.presented;
+
+	// too far behind, the stamps were reused
+	if (presented - seen > FRAME_QUEUE_LEN)
+		seen = presented - FRAME_QUEUE_LEN;
+	for (; seen != presented; seen++) {
+		volatile struct frame_stamp *st =
+			&ctrl->stamps[seen & FRAME_QUEUE_MASK];
+		uint32_t tag = st->tag, flip = st->flip, lit = st->lit;
+
+		// a black frame never lights, once the next one is up it
+		// never will
+		if (!lit) {
+			if (seen + 1 == presented)
+				break;	// not on yet
+			continue;
+		}
+		if (tag == 0 || tag > n)
+			continue;	// someone else's
+		ft[tag - 1].flip = flip;
+		ft[tag - 1].lit = lit;
+		ft[tag - 1].shown = 1;
+	}
+	return seen;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void stage(const char *name, double *v, uint32_t n)
+{
+	qsort(v, n, sizeof(*v), cmp_double);
+	printf("%-8s %9.1f %9.1f %9.1f %9.1f\n", name,
+	       v[n / 2] * 1e6, v[n * 9 / 10] * 1e6, v[n * 99 / 100] * 1e6,
+	       v[n - 1] * 1e6);
+}
+
+static void report(const struct frame_times *ft, uint32_t n, uint32_t dropped)
+{
+	double *v[5];
+	uint32_t i, k, shown = 0;
+
+	for (k = 0; k < 5; k++)
+		v[k] = calloc(n, sizeof(double));
+	for (i = 0; i < n; i++) {
+		double flip, lit;
+
+		if (!ft[i].shown)
+			continue;
+		flip = clock_host(ft[i].flip);
+		lit = clock_host(ft[i].lit);
+		v[0][shown] = ft[i].loaded - ft[i].handed;
+		v[1][shown] = ft[i].uploaded - ft[i].loaded;
+		v[2][shown] = flip - ft[i].uploaded;
+		v[3][shown] = lit - flip;
+		v[4][shown] = lit - ft[i].handed;
+		shown++;
+	}
+
+	printf("frames   %u shown of %u, %u dropped by the PRU\n",
+	       shown, n, dropped);
+	printf("clock    %.2f MHz as seen from here\n", clock_rate() / 1e6);
+	if (shown) {
+		printf("us             p50       p90       p99       max\n");
+		stage("load", v[0], shown);
+		stage("upload", v[1], shown);
+		stage("queue", v[2], shown);
+		stage("light", v[3], shown);
+		stage("total", v[4], shown);
+	}
+	for (k = 0; k < 5; k++)
+		free(v[k]);
+}
+
+static int write_csv(const char *path, const struct frame_times *ft,
+		     uint32_t n)
+{
+	FILE *f = fopen(path, "w");
+	double t0 = n ? ft[0].handed : 0;
+	uint32_t i;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	fprintf(f, "frame,handed,loaded,uploaded,flip,lit\n");
+	for (i = 0; i < n; i++) {
+		fprintf(f, "%u,%.1f,%.1f,%.1f", i + 1,
+			(ft[i].handed - t0) * 1e6, (ft[i].loaded - t0) * 1e6,
+			(ft[i].uploaded - t0) * 1e6);
+		if (ft[i].shown)
+			fprintf(f, ",%.1f,%.1f\n",
+				(clock_host(ft[i].flip) - t0) * 1e6,
+				(clock_host(ft[i].lit) - t0) * 1e6);
+		else
+			fprintf(f, ",,\n");
+	}
+	return fclose(f);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s -a <ddr phys> [-m mem] [-d ddr]"
+		" [-n frames] [-i usec] [-o file.csv] frame...\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *mem = PRU_MEM_DEFAULT, *ddr = PRU_MEM_DEFAULT;
+	const char *csv = NULL;
+	unsigned long ddr_phys = 0, interval = 1000000 / 30;
+	uint32_t n = 100, i, head, seen, dropped;
+	struct frame_times *ft;
+	uint8_t *frames, *staged;
+	size_t slot_size;
+	double next, until;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "a:m:d:n:i:o:")) != -1) {
+		switch (opt) {
+		case 'a': ddr_phys = strtoul(optarg, NULL, 0); break;
+		case 'm': mem = optarg; break;
+		case 'd': ddr = optarg; break;
+		case 'n': n = strtoul(optarg, NULL, 0); break;
+		case 'i': interval = strtoul(optarg, NULL, 0); break;
+		case 'o': csv = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (!ddr_phys || !n || optind >= argc)
+		usage(argv[0]);
+
+	ctrl = pru_ctrl_map(mem);
+	if (!ctrl)
+		return 1;
+	for (until = host_secs() + 5; ctrl->magic != SHARED_CTRL_MAGIC; ) {
+		if (host_secs() > until) {
+			fprintf(stderr, "firmware isn't running\n");
+			return 1;
+		}
+		usleep(10000);
+	}
+
+	slot_size = FRAME_SLOT_SIZE(ctrl->frame_size);
+	frames = pru_mem_map(ddr, ddr_phys, slot_size * FRAME_QUEUE_LEN);
+	staged = malloc(slot_size);
+	ft = calloc(n, sizeof(*ft));
+	if (!frames || !staged || !ft)
+		return 1;
+
+	head = ctrl->q_head;
+	seen = ctrl->qstats.presented;
+	dropped = ctrl->qstats.dropped;
+	next = host_secs();
+
+	for (i = 0; i < n; i++) {
+		uint32_t slot = head & FRAME_QUEUE_MASK;
+
+		poll_for(next - host_secs());
+		next += interval * 1e-6;
+		while (head - ctrl->q_tail >= FRAME_QUEUE_LEN) {
+			seen = collect(ft, n, seen);
+			poll_for(POLL_USEC * 1e-6);
+		}
+
+		ft[i].handed = host_secs();
+		if (pru_frame_read(argv[optind + i % (argc - optind)], staged,
+				   ctrl->frame_size))
+			return 1;
+		ft[i].loaded = host_secs();
+
+		memcpy(frames + slot * slot_size, staged, slot_size);
+		ctrl->queue[slot].addr = ddr_phys + slot * slot_size;
+		ctrl->queue[slot].pts = ctrl->clock;	// due right away
+		ctrl->queue[slot].tag = i + 1;
+		/* descriptor must land before the head moves */
+		__sync_synchronize();
+		ctrl->q_head = ++head;
+		ft[i].uploaded = host_secs();
+
+		seen = collect(ft, n, seen);
+	}
+
+	// the last ones, a frame that is still queued might yet be dropped
+	for (until = host_secs() + DRAIN_SECS; host_secs() < until; ) {
+		seen = collect(ft, n, seen);
+		if (ctrl->q_tail == head && seen == ctrl->qstats.presented)
+			break;
+		poll_for(POLL_USEC * 1e-6);
+	}
+
+	report(ft, n, ctrl->qstats.dropped - dropped);
+	if (csv && write_csv(csv, ft, n))
+		return 1;
+
+	pru_mem_unmap(frames, slot_size * FRAME_QUEUE_LEN);
+	pru_ctrl_unmap(ctrl);
+	return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * hub75_lock.c
+ *
+ * set the frame lock mode of the PRU driver and show the lock status.
+ *
+ *   hub75_lock [-m mem] [free|slave|master]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pru_mem.h"
+#include "frame_lock.h"
+
+static const char *modes[] = {
+	[LOCK_FREE] = "free",
+	[LOCK_SLAVE] = "slave",
+	[LOCK_MASTER] = "master",
+};
+
+int main(int argc, char **argv)
+{
+	const char *mem = PRU_MEM_DEFAULT;
+	volatile struct shared_ctrl *ctrl;
+	uint32_t mode;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:")) != -1) {
+		switch (opt) {
+		case 'm': mem = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-m mem] [free|slave|master]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	ctrl = pru_ctrl_map(mem);
+	if (!ctrl)
+		return 1;
+
+	if (optind < argc) {
+		for (mode = 0; mode < sizeof(modes) / sizeof(modes[0]); mode++)
+			if (!strcmp(argv[optind], modes[mode]))
+				break;
+		if (mode == sizeof(modes) / sizeof(modes[0])) {
+			fprintf(stderr, "unknown mode %s\n", argv[optind]);
+			return 1;
+		}
+		ctrl->lock_mode = mode;
+	}
+
+	mode = ctrl->lock_mode;
+	printf("mode %s", mode < sizeof(modes) / sizeof(modes[0]) ?
+	       modes[mode] : "?");
+	if (mode == LOCK_SLAVE)
+		printf(", %s, phase %+.2f us, correction %+d cycles/frame,"
+		       " %u frames without sync",
+		       ctrl->locked ? "locked" : "unlocked",
+		       ctrl->lock_phase / (double) PRU_CYCLES_PER_US,
+		       ctrl->lock_corr, ctrl->lock_missed);
+	printf("\n");
+
+	pru_ctrl_unmap(ctrl);
+	return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * hub75_plan.c
+ *
+ * refresh and capacity of a panel configuration, from the model in
+ * refresh_plan.h.  needs no PRU, the defaults are the profile in
+ * panel_wiring.h and the constants of pru1_pixel_driver.c.
+ *
+ *   hub75_plan [-W width] [-H height] [-l lines] [-b bits] [-p panels]
+ *              [-k khz] [-u lsb] [-t t0,t1,..] [-d dim] [-r hz]
+ *              [-o oe_ns]
+ *
+ * -W/-H/-l  panel size and scan lines (1/N scan)
+ * -b        bits, a binary table of 1, 2, 4 .. LSBs
+ * -p        panels in the chain, default as many as the buffer holds
+ * -k        pixel clock, the kernel the firmware would pick is used
+ * -u        LSB on-time, cycles, default the one the firmware would
+ *           calibrate to (see lsb_pick() in pru1_pixel_driver.c)
+ * -t        an explicit table of on-times in cycles, one per plane
+ * -d        DIM interval, cycles
+ * -r        refresh the configuration has to reach
+ * -o        shortest OE pulse the driver ICs pass, ns
+ *
+ * prints the refresh, duty cycle and LSB limits, how many panels a
+ * chain can have, and FAIL for everything that doesn't work.  exits 1
+ * if anything failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shared_ctrl.h"
+#include "panel_wiring.h"
+#include "refresh_plan.h"
+#include "pru1_pixel_driver.h"
+
+/* the display buffer ends where the control block starts */
+#define BUFFER_LEN	SHARED_CTRL_OFFSET
+
+static const struct {
+	uint32_t khz;
+	uint32_t cycles;	/* a clock, lo + hi in shift_kernel.asm */
+} kernels[] = {
+	{ 28571, 7 },
+	{ 25000, 8 },
+	{ 20000, 10 },
+};
+#define N_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static int failed;
+
+static void fail(const char *what)
+{
+	printf("FAIL      %s\n", what);
+	failed = 1;
+}
+
+static double us(unsigned long cycles)
+{
+	return cycles * 1e6 / PLAN_PRU_HZ;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long w = W_PANEL, h = H_PANEL, lines = N_LINES;
+	unsigned long bits = N_BITS, panels = 0, khz = BITCLOCK_DEFAULT;
+	unsigned long lsb = 0, dim = DIM_DELAY, refresh_min = REFRESH_MIN;
+	unsigned long oe_ns = 50, t[PLANE_FLAGS_LEN], planes = 0;
+	unsigned long on_sum, overhead, frame, clk, scanlen, per_panel;
+	unsigned long buffer_panels, refresh_panels, lsb_min, budget, p;
+	char *s, *end;
+	int opt, k;
+
+	while ((opt = getopt(argc, argv, "W:H:l:b:p:k:u:t:d:r:o:")) != -1) {
+		switch (opt) {
+		case 'W': w = strtoul(optarg, NULL, 0); break;
+		case 'H': h = strtoul(optarg, NULL, 0); break;
+		case 'l': lines = strtoul(optarg, NULL, 0); break;
+		case 'b': bits = strtoul(optarg, NULL, 0); break;
+		case 'p': panels = strtoul(optarg, NULL, 0); break;
+		case 'k': khz = strtoul(optarg, NULL, 0); break;
+		case 'u': lsb = strtoul(optarg, NULL, 0); break;
+		case 'd': dim = strtoul(optarg, NULL, 0); break;
+		case 'r': refresh_min = strtoul(optarg, NULL, 0); break;
+		case 'o': oe_ns = strtoul(optarg, NULL, 0); break;
+		case 't':
+			for (s = optarg, planes = 0; *s; s = end) {
+				if (planes == PLANE_FLAGS_LEN) {
+					fprintf(stderr, "at most %u planes\n",
+						PLANE_FLAGS_LEN);
+					return 1;
+				}
+				t[planes++] = strtoul(s, &end, 0);
+				if (end == s) {
+					fprintf(stderr, "bad table %s\n", optarg);
+					return 1;
+				}
+				if (*end == ',')
+					end++;
+			}
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-W width] [-H height]"
+				" [-l lines] [-b bits] [-p panels] [-k khz]"
+				" [-u lsb] [-t t0,t1,..] [-d dim] [-r hz]"
+				" [-o oe_ns]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!w || !h || !lines || !bits || bits > 16 || h % (2 * lines)) {
+		fprintf(stderr, "height has to be a multiple of 2 * lines\n");
+		return 1;
+	}
+
+	// the fastest kernel that isn't faster than asked for, as shift_select()
+	for (k = 0; k < (int) N_KERNELS - 1; k++)
+		if (kernels[k].khz <= khz)
+			break;
+	clk = kernels[k].cycles;
+
+	per_panel = PLAN_SCANLEN(1, w, h, lines);
+	buffer_panels = BUFFER_LEN /
+		PLAN_BUFFER_BYTES(per_panel, lines, planes ? planes : bits);
+	if (!panels)
+		panels = buffer_panels ? buffer_panels : 1;
+	scanlen = panels * per_panel;
+	overhead = PLAN_PLANE_OVERHEAD(scanlen, clk, dim);
+	budget = PLAN_PRU_HZ / (refresh_min ? refresh_min : 1) / lines;
+
+	if (!planes) {
+		planes = bits;
+		if (!lsb) {	// as lsb_pick()
+			lsb = PLAN_LSB_FIT(bits, overhead);
+			if (budget < bits * overhead)
+				lsb = 0;
+			else if (lsb > (budget - bits * overhead) /
+				       PLAN_BINARY_SUM(bits, 1))
+				lsb = (budget - bits * overhead) /
+				      PLAN_BINARY_SUM(bits, 1);
+			if (lsb < PLAN_LSB_MIN)
+				lsb = PLAN_LSB_MIN;
+		}
+		for (p = 0; p < planes; p++)
+			t[p] = lsb << p;
+	}
+	for (p = 0, on_sum = 0; p < planes; p++)
+		on_sum += t[p];
+	frame = PLAN_FRAME(lines, planes, on_sum, overhead);
+
+	printf("panels    %lu of %lux%lu, 1/%lu scan, %lu planes\n",
+	       panels, w, h, lines, planes);
+	printf("scanline  %lu bytes, buffer %lu of %lu bytes\n", scanlen,
+	       PLAN_BUFFER_BYTES(scanlen, lines, planes), BUFFER_LEN);
+	printf("clock     %.1f MHz (%lu cycles)  shift %.2f us a plane\n",
+	       kernels[k].khz / 1000.0, clk, us(scanlen * clk));
+	printf("plane     %.2f us besides the on-time\n", us(overhead));
+	printf("frame     %.1f us  refresh %.1f Hz\n", us(frame),
+	       (double) PLAN_PRU_HZ / frame);
+	printf("duty      %.2f %% lit, %.2f %% for each LED at full scale\n",
+	       100.0 * lines * on_sum / frame, 100.0 * on_sum / frame);
+
+	// LSB: the overrun has to stay small, and the drivers pass a pulse
+	lsb_min = PLAN_LSB_MIN;
+	if (oe_ns / 5 > lsb_min)
+		lsb_min = oe_ns / 5;
+	printf("LSB       %.3f us, at least %.3f us",
+	       us(t[0]), us(lsb_min));
+	if (budget > planes * overhead)
+		printf(", at most %.3f us for %lu Hz\n",
+		       us(t[0] * (budget - planes * overhead) / on_sum),
+		       refresh_min);
+	else
+		printf(", none reaches %lu Hz\n", refresh_min);
+
+	// a chain: each panel adds per_panel clocks to every plane
+	refresh_panels = 0;
+	if (budget > on_sum + planes * (dim + PLAN_PLANE_FIXED))
+		refresh_panels = (budget - on_sum - planes * (dim + PLAN_PLANE_FIXED)) /
+				 (planes * per_panel * clk);
+	printf("chain     %lu panels for %lu Hz, %lu fit the buffer\n",
+	       refresh_panels, refresh_min, buffer_panels);
+
+	if (per_panel % 8)
+		fail("scanline not a multiple of 8 bytes, the kernels need it");
+	if (lines > 8)
+		fail("more lines than the A, B, C address pins");
+	if (lines * planes > PLANE_FLAGS_LEN)
+		fail("more planes than PLANE_FLAGS_LEN");
+	if (planes > INFO_PLANES)
+		fail("more planes than INFO_PLANES");
+	if (PLAN_BUFFER_BYTES(scanlen, lines, planes) > BUFFER_LEN)
+		fail("frame doesn't fit the display buffer");
+	if (refresh_min && PLAN_PRU_HZ / frame < refresh_min)
+		fail("refresh below the target");
+	for (p = 0; p < planes; p++)
+		if (t[p] < lsb_min) {
+			fail("on-time shorter than the LSB minimum");
+			break;
+		}
+	if (!failed)
+		printf("ok\n");
+	return failed;
+}
@@ -0,0 +1,96 @@
+/*
+ * hub75_queue.c
+ *
+ * queue pre-encoded frames for timed presentation by the PRU driver.
+ *
+ *   hub75_queue -a <ddr phys> [-m mem] [-d ddr] [-i usec] [-s usec] frame...
+ *
+ * each frame file holds one encoded display buffer (ctrl->frame_size
+ * bytes, the layout load_test_pattern() produces), optionally followed
+ * by a FRAME_INFO_LEN struct frame_info.  frames are copied
+ * into the DDR region at <ddr phys>, one slot per queue entry, and
+ * stamped to go up every <usec> starting <usec> from now.
+ *
+ * the DDR region must be reserved from the kernel (e.g. with a
+ * reserved-memory node) and hold FRAME_QUEUE_LEN frames.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "pru_mem.h"
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s -a <ddr phys> [-m mem] [-d ddr]"
+		" [-i interval usec] [-s start usec] frame...\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *mem = PRU_MEM_DEFAULT, *ddr = PRU_MEM_DEFAULT;
+	unsigned long ddr_phys = 0;
+	unsigned long interval = 1000000 / 30, start = 100000;
+	volatile struct shared_ctrl *ctrl;
+	uint8_t *frames;
+	size_t slot_size;
+	uint32_t head, pts;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "a:m:d:i:s:")) != -1) {
+		switch (opt) {
+		case 'a': ddr_phys = strtoul(optarg, NULL, 0); break;
+		case 'm': mem = optarg; break;
+		case 'd': ddr = optarg; break;
+		case 'i': interval = strtoul(optarg, NULL, 0); break;
+		case 's': start = strtoul(optarg, NULL, 0); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (!ddr_phys || optind >= argc)
+		usage(argv[0]);
+
+	ctrl = pru_ctrl_map(mem);
+	if (!ctrl)
+		return 1;
+	if (!ctrl->frame_size) {
+		fprintf(stderr, "firmware hasn't published a frame size\n");
+		return 1;
+	}
+
+	slot_size = FRAME_SLOT_SIZE(ctrl->frame_size);
+	frames = pru_mem_map(ddr, ddr_phys, slot_size * FRAME_QUEUE_LEN);
+	if (!frames)
+		return 1;
+
+	head = ctrl->q_head;
+	pts = ctrl->clock + start * PRU_CYCLES_PER_US;
+
+	for (i = optind; i < argc; i++) {
+		uint32_t slot = head & FRAME_QUEUE_MASK;
+
+		/* wait for the PRU to free a slot */
+		while (head - ctrl->q_tail >= FRAME_QUEUE_LEN)
+			usleep(1000);
+
+		if (pru_frame_read(argv[i], frames + slot * slot_size,
+				   ctrl->frame_size))
+			break;
+
+		ctrl->queue[slot].addr = ddr_phys + slot * slot_size;
+		ctrl->queue[slot].pts = pts;
+		ctrl->queue[slot].tag = head;
+		/* descriptor must land before the head moves */
+		__sync_synchronize();
+		ctrl->q_head = ++head;
+
+		pts += interval * PRU_CYCLES_PER_US;
+	}
+
+	pru_mem_unmap(frames, slot_size * FRAME_QUEUE_LEN);
+	pru_ctrl_unmap(ctrl);
+	return i == argc ? 0 : 1;
+}
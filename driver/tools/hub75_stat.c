@@ -0,0 +1,149 @@
+/*
+ * hub75_stat.c
+ *
+ * sample the PRU driver control block and print rates.
+ *
+ *   hub75_stat [-m mem] [-i msec] [-n count]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "pru_mem.h"
+
+struct sample {
+	uint32_t clock;
+	uint32_t frames;
+	uint32_t queued;
+	struct queue_stats q;
+	struct elide_stats e;
+	struct perf_stats p;
+	uint8_t planes;
+	uint32_t plane_time[INFO_PLANES];
+	uint16_t est_ma, peak_ma, scale;
+	uint32_t lsb, shift;
+};
+
+static void take_sample(volatile struct shared_ctrl *ctrl, struct sample *s)
+{
+	int i;
+
+	s->clock = ctrl->clock;
+	s->frames = ctrl->frame_count;
+	s->queued = ctrl->q_head - ctrl->q_tail;
+	s->q.presented = ctrl->qstats.presented;
+	s->q.dropped = ctrl->qstats.dropped;
+	s->q.jitter_last = ctrl->qstats.jitter_last;
+	s->q.jitter_max = ctrl->qstats.jitter_max;
+	s->q.jitter_sum = ctrl->qstats.jitter_sum;
+	s->e.zero = ctrl->elide.zero;
+	s->e.same = ctrl->elide.same;
+	s->e.last_frame = ctrl->elide.last_frame;
+	s->p.shifted = ctrl->perf.shifted;
+	s->p.shift_sum = ctrl->perf.shift_sum;
+	s->p.shift_max = ctrl->perf.shift_max;
+	s->p.missed = ctrl->perf.missed;
+	s->planes = ctrl->info.planes;
+	for (i = 0; i < INFO_PLANES; i++)
+		s->plane_time[i] = ctrl->info.plane_time[i];
+	s->est_ma = ctrl->info.est_ma;
+	s->peak_ma = ctrl->info.peak_ma;
+	s->scale = ctrl->info.scale;
+	s->lsb = ctrl->lsb_cycles;
+	s->shift = ctrl->shift_cycles;
+}
+
+static void print_timing(const struct sample *s)
+{
+	int i;
+
+	printf("  lsb: %.3f us, a scanline shifts in %.2f us\n",
+	       (double) s->lsb / PRU_CYCLES_PER_US,
+	       (double) s->shift / PRU_CYCLES_PER_US);
+	if (!s->planes) {
+		printf("  planes: full depth\n");
+		return;
+	}
+	printf("  planes: %u, on-time", s->planes);
+	for (i = 0; i < s->planes && i < INFO_PLANES; i++)
+		printf(" %.1f", (double) s->plane_time[i] / PRU_CYCLES_PER_US);
+	printf(" us\n");
+	if (s->scale)
+		printf("  current: est %u mA  peak %u mA  on-time %.0f%%\n",
+		       s->est_ma, s->peak_ma, s->scale * 100.0 / 256);
+}
+
+static void print_rates(const struct sample *a, const struct sample *b)
+{
+	double secs = (double)(uint32_t)(b->clock - a->clock) /
+		      (PRU_CYCLES_PER_US * 1e6);
+	uint32_t presented = b->q.presented - a->q.presented;
+	uint32_t jitter = b->q.jitter_sum - a->q.jitter_sum;
+	uint32_t frames = b->frames - a->frames;
+	uint32_t shifted = b->p.shifted - a->p.shifted;
+	uint32_t shift = b->p.shift_sum - a->p.shift_sum;
+
+	if (secs <= 0) {
+		printf("clock not moving, is the firmware running?\n");
+		return;
+	}
+
+	printf("refresh %7.1f Hz  presented %6.1f/s  dropped %u (%u total)"
+	       "  jitter avg %7.1f max %7.1f us  queued %u\n",
+	       frames / secs, presented / secs,
+	       b->q.dropped - a->q.dropped, b->q.dropped,
+	       presented ? (double) jitter / presented / PRU_CYCLES_PER_US : 0.0,
+	       (double) b->q.jitter_max / PRU_CYCLES_PER_US,
+	       b->queued);
+	if (frames)
+		printf("  skipped planes/frame: black %.1f  latched %.1f  last %u\n",
+		       (double)(b->e.zero - a->e.zero) / frames,
+		       (double)(b->e.same - a->e.same) / frames,
+		       b->e.last_frame);
+	printf("  shifted %8.0f/s  shift avg %.2f max %.2f us"
+	       "  missed deadlines %u (%u total)\n",
+	       shifted / secs,
+	       shifted ? (double) shift / shifted / PRU_CYCLES_PER_US : 0.0,
+	       (double) b->p.shift_max / PRU_CYCLES_PER_US,
+	       b->p.missed - a->p.missed, b->p.missed);
+	print_timing(b);
+}
+
+int main(int argc, char **argv)
+{
+	const char *mem = PRU_MEM_DEFAULT;
+	unsigned long interval = 1000;
+	long count = -1;
+	volatile struct shared_ctrl *ctrl;
+	struct sample prev, cur;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:i:n:")) != -1) {
+		switch (opt) {
+		case 'm': mem = optarg; break;
+		case 'i': interval = strtoul(optarg, NULL, 0); break;
+		case 'n': count = strtol(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-m mem] [-i msec] [-n count]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	ctrl = pru_ctrl_map(mem);
+	if (!ctrl)
+		return 1;
+
+	take_sample(ctrl, &prev);
+	while (count < 0 || count-- > 0) {
+		usleep(interval * 1000);
+		take_sample(ctrl, &cur);
+		print_rates(&prev, &cur);
+		prev = cur;
+	}
+
+	pru_ctrl_unmap(ctrl);
+	return 0;
+}
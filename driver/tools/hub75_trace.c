@@ -0,0 +1,267 @@
+/*
+ * hub75_trace.c
+ *
+ * start the PRU event trace, or turn what is in the ring into a Chrome
+ * trace (chrome://tracing, ui.perfetto.dev).  needs a firmware built
+ * with make TRACE=1, see struct trace_ring in shared_ctrl.h.
+ *
+ *   hub75_trace [-m mem] [-s off|run|miss] [-w sec] [-o trace.json]
+ *
+ * -s  set the mode and (re)start the trace.  miss stops half a ring
+ *     after a missed deadline.
+ * -w  wait up to sec for a miss to stop the trace before reading it
+ * -o  read the ring into this file, - for stdout.  the default without
+ *     -s.
+ *
+ * the timeline has a track for the frames, one for the lit planes, one
+ * for shift and DIM, and the rest (misses, flips, drops, changes) as
+ * instant events.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pru_mem.h"
+#include "panel_wiring.h"
+
+#define TID_FRAMES	1
+#define TID_LIT		2
+#define TID_SHIFT	3
+#define TID_EVENTS	4
+
+static const char *modes[] = { "off", "run", "miss" };
+#define N_MODES (sizeof(modes) / sizeof(modes[0]))
+
+static const char *names[] = {
+	[TRACE_FRAME] = "frame",
+	[TRACE_SHIFT] = "shift",
+	[TRACE_LATCH] = "latch",
+	[TRACE_ON] = "on",
+	[TRACE_SKIP] = "skip",
+	[TRACE_LATE] = "missed deadline",
+	[TRACE_FLIP] = "flip",
+	[TRACE_DROP] = "drop",
+	[TRACE_CLOCK] = "pixel clock",
+	[TRACE_LSB] = "lsb",
+	[TRACE_LOCK] = "lock mode",
+};
+#define N_NAMES (sizeof(names) / sizeof(names[0]))
+
+static FILE *out;
+static int first = 1;
+
+static void sep(void)
+{
+	fprintf(out, first ? "\n" : ",\n");
+	first = 0;
+}
+
+static void thread(int tid, const char *name)
+{
+	sep();
+	fprintf(out, "{\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+		"\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+		tid, name);
+}
+
+static double us(uint64_t cycles)
+{
+	return (double) cycles / PRU_CYCLES_PER_US;
+}
+
+/* a span on tid from start to end, named after a plane */
+static void span(int tid, const char *what, uint64_t start, uint64_t end,
+		 unsigned plane)
+{
+	sep();
+	fprintf(out, "{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,"
+		"\"dur\":%.3f,\"name\":\"%s %u.%u\","
+		"\"args\":{\"line\":%u,\"bit\":%u}}",
+		tid, us(start), us(end - start), what,
+		plane / N_BITS, plane % N_BITS, plane / N_BITS, plane % N_BITS);
+}
+
+static void frame_span(uint64_t start, uint64_t end, unsigned frame)
+{
+	sep();
+	fprintf(out, "{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,"
+		"\"dur\":%.3f,\"name\":\"frame %u\"}", TID_FRAMES,
+		us(start), us(end - start), frame);
+}
+
+static void instant(uint64_t t, uint16_t event, uint16_t arg)
+{
+	sep();
+	fprintf(out, "{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,"
+		"\"ts\":%.3f,\"name\":\"%s\",\"args\":{\"arg\":%u}}",
+		TID_EVENTS, us(t),
+		event < N_NAMES && names[event] ? names[event] : "?", arg);
+}
+
+static void convert(const struct trace_rec *rec, uint32_t n)
+{
+	uint64_t t = 0, frame_at = 0, lit_at = 0, shift_at = 0, dim_at = 0;
+	unsigned frame = 0, lit = 0, shifting = 0, dim = 0;
+	int in_frame = 0, in_lit = 0, in_shift = 0, in_dim = 0;
+	uint32_t i;
+
+	fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	sep();
+	fprintf(out, "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\","
+		"\"args\":{\"name\":\"PRU1 hub75\"}}");
+	thread(TID_FRAMES, "frames");
+	thread(TID_LIT, "lit");
+	thread(TID_SHIFT, "shift, DIM");
+	thread(TID_EVENTS, "events");
+
+	for (i = 0; i < n; i++) {
+		uint16_t event = rec[i].event, arg = rec[i].arg;
+
+		// 32 bit cycle clock, the records are never 21 s apart
+		if (i)
+			t += (uint32_t)(rec[i].cycle - rec[i - 1].cycle);
+
+		// everything that turns a plane off ends the lit span
+		if (in_lit && (event == TRACE_SHIFT || event == TRACE_SKIP ||
+			       event == TRACE_FLIP)) {
+			span(TID_LIT, "lit", lit_at, t, lit);
+			in_lit = 0;
+		}
+
+		switch (event) {
+		case TRACE_FRAME:
+			if (in_frame)
+				frame_span(frame_at, t, frame);
+			in_frame = 1;
+			frame_at = t;
+			frame = arg;
+			break;
+		case TRACE_SHIFT:
+			in_shift = 1;
+			shift_at = t;
+			shifting = arg;
+			break;
+		case TRACE_LATCH:
+			if (in_shift && shifting == arg)
+				span(TID_SHIFT, "shift", shift_at, t, arg);
+			in_shift = 0;
+			in_dim = 1;
+			dim_at = t;
+			dim = arg;
+			break;
+		case TRACE_ON:
+			if (in_dim && dim == arg)
+				span(TID_SHIFT, "dim", dim_at, t, arg);
+			in_dim = 0;
+			in_lit = 1;
+			lit_at = t;
+			lit = arg;
+			break;
+		default:
+			instant(t, event, arg);
+			break;
+		}
+	}
+	// the frame the ring ends in, as far as it goes
+	if (in_frame)
+		frame_span(frame_at, t, frame);
+	fprintf(out, "\n]}\n");
+}
+
+/* the records that weren't overwritten while we copied them */
+static uint32_t snapshot(volatile struct shared_ctrl *ctrl,
+			 struct trace_rec *rec)
+{
+	uint32_t head = ctrl->trace.head, after, start, n, i;
+
+	n = head < TRACE_LEN ? head : TRACE_LEN;
+	for (i = 0; i < TRACE_LEN; i++) {
+		rec[i].cycle = ctrl->trace.ring[i].cycle;
+		rec[i].event = ctrl->trace.ring[i].event;
+		rec[i].arg = ctrl->trace.ring[i].arg;
+	}
+	after = ctrl->trace.head;
+	start = head - n;
+	if (after - start > TRACE_LEN)
+		start = after - TRACE_LEN;
+	if (start > head)
+		return 0;
+	n = head - start;
+
+	// put them in order
+	for (i = 0; i < n; i++)
+		rec[TRACE_LEN + i] = rec[(start + i) & TRACE_MASK];
+	memmove(rec, rec + TRACE_LEN, n * sizeof(*rec));
+	return n;
+}
+
+int main(int argc, char **argv)
+{
+	const char *mem = PRU_MEM_DEFAULT, *path = NULL;
+	volatile struct shared_ctrl *ctrl;
+	static struct trace_rec rec[2 * TRACE_LEN];
+	long mode = -1, wait = 0;
+	uint32_t n;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:s:w:o:")) != -1) {
+		switch (opt) {
+		case 'm': mem = optarg; break;
+		case 's':
+			for (mode = 0; mode < (long) N_MODES; mode++)
+				if (!strcmp(optarg, modes[mode]))
+					break;
+			if (mode == N_MODES) {
+				fprintf(stderr, "mode is off, run or miss\n");
+				return 1;
+			}
+			break;
+		case 'w': wait = strtol(optarg, NULL, 0); break;
+		case 'o': path = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-m mem] [-s off|run|miss]"
+				" [-w sec] [-o trace.json]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	ctrl = pru_ctrl_map(mem);
+	if (!ctrl)
+		return 1;
+	if (!ctrl->trace.built)
+		fprintf(stderr, "warning: the firmware has no trace,"
+			" build it with make TRACE=1\n");
+
+	if (mode >= 0) {
+		ctrl->trace.mode = mode;
+		ctrl->trace.seq++;
+		if (!path) {
+			pru_ctrl_unmap(ctrl);
+			return 0;
+		}
+	}
+
+	while (wait-- > 0 && !ctrl->trace.stopped)
+		sleep(1);
+
+	n = snapshot(ctrl, rec);
+	fprintf(stderr, "%u records%s\n", n,
+		ctrl->trace.stopped ? ", stopped after a missed deadline" : "");
+
+	out = stdout;
+	if (path && strcmp(path, "-")) {
+		out = fopen(path, "w");
+		if (!out) {
+			perror(path);
+			return 1;
+		}
+	}
+	convert(rec, n);
+	if (out != stdout)
+		fclose(out);
+
+	pru_ctrl_unmap(ctrl);
+	return 0;
+}
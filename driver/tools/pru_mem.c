@@ -0,0 +1,110 @@
+/*
+ * pru_mem.c
+ *
+ * see pru_mem.h
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pru_mem.h"
+
+void *pru_mem_map(const char *path, unsigned long phys, size_t len)
+{
+	struct stat st;
+	unsigned long page, skew;
+	void *p;
+	int fd;
+
+	fd = open(path, O_RDWR | O_SYNC | O_CREAT, 0644);
+	if (fd < 0) {
+		perror(path);
+		return NULL;
+	}
+	if (fstat(fd, &st) < 0) {
+		perror(path);
+		close(fd);
+		return NULL;
+	}
+
+	if (S_ISREG(st.st_mode)) {
+		/* stand-in file, the region starts at offset 0 */
+		if ((size_t) st.st_size < len && ftruncate(fd, len) < 0) {
+			perror(path);
+			close(fd);
+			return NULL;
+		}
+		phys = 0;
+	}
+
+	page = sysconf(_SC_PAGESIZE);
+	skew = phys & (page - 1);
+
+	p = mmap(NULL, len + skew, PROT_READ | PROT_WRITE, MAP_SHARED,
+		 fd, phys - skew);
+	close(fd);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	return (uint8_t *) p + skew;
+}
+
+void pru_mem_unmap(void *p, size_t len)
+{
+	unsigned long page = sysconf(_SC_PAGESIZE);
+	unsigned long skew = (unsigned long) p & (page - 1);
+
+	munmap((uint8_t *) p - skew, len + skew);
+}
+
+int pru_frame_read(const char *name, uint8_t *slot, size_t len)
+{
+	uint8_t *info = slot + FRAME_PLANES_SIZE(len);
+	FILE *f = fopen(name, "rb");
+	size_t n;
+
+	if (!f) {
+		perror(name);
+		return -1;
+	}
+	n = fread(slot, 1, len, f);
+	if (n == len)
+		n += fread(info, 1, FRAME_INFO_LEN, f);
+	fclose(f);
+
+	if (n == len) {
+		/* no info, full depth and nothing gets skipped */
+		memset(info, 0, FRAME_INFO_LEN);
+	} else if (n != len + FRAME_INFO_LEN) {
+		fprintf(stderr, "%s: expected %zu or %zu bytes, got %zu\n",
+			name, len, len + FRAME_INFO_LEN, n);
+		return -1;
+	}
+	return 0;
+}
+
+volatile struct shared_ctrl *pru_ctrl_map(const char *path)
+{
+	volatile struct shared_ctrl *ctrl;
+
+	ctrl = pru_mem_map(path, PRUSS_SHARED_RAM_PHYS + SHARED_CTRL_OFFSET,
+			   SHARED_CTRL_SIZE);
+	if (!ctrl)
+		return NULL;
+
+	if (ctrl->magic != SHARED_CTRL_MAGIC)
+		fprintf(stderr, "warning: no control block magic at %s,"
+			" is the firmware running?\n", path);
+	return ctrl;
+}
+
+void pru_ctrl_unmap(volatile struct shared_ctrl *ctrl)
+{
+	pru_mem_unmap((void *) ctrl, SHARED_CTRL_SIZE);
+}
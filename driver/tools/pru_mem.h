@@ -0,0 +1,37 @@
+/*
+ * pru_mem.h
+ *
+ * map PRU shared RAM and DDR frame memory into a userspace tool.
+ *
+ * on the board the path is /dev/mem and the physical address is used.
+ * anywhere else the path can name a regular file, which then stands in
+ * for the region (offset 0, grown to the requested length).  that lets
+ * the tools run against a recorded or simulated block off-board.
+ */
+
+#ifndef PRU_MEM_H
+#define PRU_MEM_H
+
+#include <stddef.h>
+#include "shared_ctrl.h"
+
+#define PRU_MEM_DEFAULT	"/dev/mem"
+
+/* PRU cycles per microsecond (200 MHz core clock) */
+#define PRU_CYCLES_PER_US	200
+
+void *pru_mem_map(const char *path, unsigned long phys, size_t len);
+void pru_mem_unmap(void *p, size_t len);
+
+/*
+ * read an encoded frame file into a queue slot (FRAME_SLOT_SIZE(len)):
+ * the planes, optionally followed by a FRAME_INFO_LEN struct frame_info.
+ * without one the info is zeroed.
+ */
+int pru_frame_read(const char *name, uint8_t *slot, size_t len);
+
+/* map the control block, complain if the firmware isn't running */
+volatile struct shared_ctrl *pru_ctrl_map(const char *path);
+void pru_ctrl_unmap(volatile struct shared_ctrl *ctrl);
+
+#endif /* PRU_MEM_H */
@@ -0,0 +1,158 @@
+/*
+ * interlace_bench.c
+ *
+ * the 1bpp loaders of ../hub12fb_interlace.h in userspace: check that
+ * the word at a time one gives the bytes of the table one, for whole
+ * frames and dirty bands, msb and lsb first, and time them across wall
+ * sizes.
+ *
+ *   interlace_bench [-m msec]
+ *
+ * -m  time each loader for msec per size (default 200)
+ *
+ * prints ns per frame (all four scan lines) and MB/s of framebuffer
+ * for each, exits 1 on a mismatch.  build it for the target (make
+ * CC=arm-linux-gnueabihf-gcc) to see the rbit path, the numbers of
+ * this machine only compare with each other.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hub12fb_interlace.h"
+
+/* modules across and down, the modes of hub12fb.c and a few bigger */
+static const struct {
+	int nx, ny;
+} walls[] = {
+	{ 1, 1 }, { 2, 1 }, { 2, 2 }, { 4, 2 }, { 6, 2 }, { 8, 4 },
+	{ 16, 4 }, { 16, 8 },
+};
+#define N_WALLS (sizeof(walls) / sizeof(walls[0]))
+
+typedef void (*loader)(u8 *lb, u8 *fb, u8 lace, u16 width, u16 j0, u16 j1,
+		       bool reverse);
+
+/* the reference first, then what has to match it */
+static const struct {
+	const char *name;
+	loader load;
+} loaders[] = {
+	{ "table", load_interlace_1bit_table },
+	{ "word", load_interlace_1bit },
+};
+#define N_LOADERS (sizeof(loaders) / sizeof(loaders[0]))
+
+static double host_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void load_frame(loader load, u8 *lb[4], u8 *fb, u16 width,
+		       u16 j0, u16 j1, bool reverse)
+{
+	u8 lace;
+
+	for (lace = 0; lace < 4; lace++)
+		load(lb[lace], fb, lace, width, j0, j1, reverse);
+}
+
+/* every loader against the first, whole and a band in the middle */
+static int check(u8 *lb[N_LOADERS][4], u8 *fb, u16 width, u16 height,
+		 size_t hsync_length, bool reverse)
+{
+	u16 bands = height / 16, j0 = bands / 3, j1 = bands - bands / 3;
+	unsigned int l, lace;
+	int failed = 0;
+
+	for (l = 0; l < N_LOADERS; l++) {
+		for (lace = 0; lace < 4; lace++)
+			memset(lb[l][lace], 0x5a, hsync_length);
+		load_frame(loaders[l].load, lb[l], fb, width, 0, bands,
+			   reverse);
+		if (j1 > j0)
+			load_frame(loaders[l].load, lb[l], fb, width, j0, j1,
+				   reverse);
+	}
+	for (l = 1; l < N_LOADERS; l++)
+		for (lace = 0; lace < 4; lace++)
+			if (memcmp(lb[0][lace], lb[l][lace], hsync_length)) {
+				printf("FAIL %ux%u %s %s scan line %u\n",
+				       width, height, loaders[l].name,
+				       reverse ? "msb" : "lsb", lace);
+				failed = 1;
+			}
+	return failed;
+}
+
+static void bench(const char *name, loader load, u8 *lb[4], u8 *fb,
+		  u16 width, u16 height, bool reverse, unsigned long msec)
+{
+	double t0 = host_secs(), until = t0 + msec * 1e-3, t;
+	unsigned long n = 0;
+
+	do {
+		load_frame(load, lb, fb, width, 0, height / 16, reverse);
+		n++;
+	} while (host_secs() < until);
+	t = host_secs() - t0;
+	printf("%3ux%-4u %-6s %-4s %12.1f %10.1f\n", width, height, name,
+	       reverse ? "msb" : "lsb", t * 1e9 / n,
+	       (double) n * width / 8 * height / t / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long msec = 200;
+	unsigned int w, l, lace, lsb;
+	int opt, failed = 0;
+
+	while ((opt = getopt(argc, argv, "m:")) != -1) {
+		switch (opt) {
+		case 'm': msec = strtoul(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-m msec]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	printf("%-8s %-6s %-4s %12s %10s\n", "wall", "loader", "spi", "ns/frame",
+	       "MB/s");
+	for (w = 0; w < N_WALLS; w++) {
+		u16 width = 32 * walls[w].nx, height = 16 * walls[w].ny;
+		size_t fb_len = width / 8 * height;
+		size_t hsync_length = fb_len / 4;
+		u8 *lb[N_LOADERS][4], *fb;
+		size_t i;
+
+		/* aligned as the driver's page and dma buffers are */
+		fb = aligned_alloc(64, fb_len);
+		for (l = 0; l < N_LOADERS; l++)
+			for (lace = 0; lace < 4; lace++)
+				lb[l][lace] = aligned_alloc(64, hsync_length);
+		srand(w + 1);
+		for (i = 0; i < fb_len; i++)
+			fb[i] = rand();
+
+		failed |= check(lb, fb, width, height, hsync_length, true);
+		failed |= check(lb, fb, width, height, hsync_length, false);
+
+		for (lsb = 0; lsb < 2; lsb++) {
+			for (l = 0; l < N_LOADERS; l++)
+				bench(loaders[l].name, loaders[l].load, lb[l],
+				      fb, width, height, !lsb, msec);
+		}
+
+		free(fb);
+		for (l = 0; l < N_LOADERS; l++)
+			for (lace = 0; lace < 4; lace++)
+				free(lb[l][lace]);
+	}
+	return failed;
+}
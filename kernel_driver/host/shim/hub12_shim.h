@@ -0,0 +1,29 @@
+/*
+ * hub12_shim.h
+ *
+ * forced in front of ../hub12fb_interlace.h (-include) for the userspace
+ * build: the kernel types and byte order helpers it uses, in plain C.
+ */
+
+#ifndef HUB12_SHIM_H
+#define HUB12_SHIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint32_t __le32;
+
+#define swab32(x) __builtin_bswap32(x)
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define le32_to_cpu(x) ((u32)(x))
+#define cpu_to_le32(x) ((__le32)(x))
+#else
+#define le32_to_cpu(x) swab32(x)
+#define cpu_to_le32(x) swab32(x)
+#endif
+
+#endif /* HUB12_SHIM_H */
@@ -29,9 +29,22 @@
 #include <linux/dma-mapping.h>
 #include <linux/hrtimer.h>
 #include <linux/backlight.h>
+#include <linux/workqueue.h>
+#include <linux/bitops.h>
+#include <linux/spinlock.h>
+#include <linux/math64.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <asm/byteorder.h>
 
 #include <linux/spi/hub12fb.h>
 
+#include "hub12fb_interlace.h"
+
+#define CREATE_TRACE_POINTS
+#include "hub12fb_trace.h"
+
 /*
  * Driver data
  */
@@ -40,26 +53,136 @@
 
 #define HUB12_MAX_FREQ 7500000
 
+/* two sets of hsync buffers, one shifting out, one being converted */
+#define HSYNC_SETS	2
+
+/*
+ * grayscale: a slot per bit plane in every scan line, binary weighted,
+ * so up to 4 planes make 16 hsync buffers a set.  check_var drops
+ * planes to keep the refresh at HUB12_MIN_REFRESH, the shortest slot
+ * has to fit HUB12_SHIFT_MARGIN times the time to shift a line out.
+ */
+#define HUB12_MAX_PLANES	4
+#define HUB12_MAX_SLOTS		(4 * HUB12_MAX_PLANES)
+#define HUB12_MIN_REFRESH	60
+#define HUB12_SHIFT_MARGIN	2
+
+/*
+ * a long wall can be split over several spi buses (or chip selects),
+ * shifting at the same time, latched and lit together by the one set
+ * of gpios.  each takes a band of module rows, which is a slice of
+ * every hsync buffer.  output 0 is the device we probed on, the
+ * others come from the spi_out= module parameter.
+ */
+#define HUB12_MAX_OUTPUTS	4
+#define HUB12_OUT_MODALIAS	HUB12FB_MODALIAS "-out"
+
+/*
+ * var.nonstd for a framebuffer that is already in wire order: the four
+ * hsync buffers back to back, each byte as it is shifted out (lsb first,
+ * 0 lights the led).  the transfers go straight out of it, nothing is
+ * converted or copied.  1 bpp on an lsb first spi master only.
+ */
+#ifndef HUB12FB_NONSTD_WIRE
+#define HUB12FB_NONSTD_WIRE	1
+#endif
+
+/*
+ * adaptive refresh: when the spi master falls behind, the refresh goes
+ * down a quarter at a time (HUB12_ADAPT_MIN_REFRESH at the least), and
+ * back up towards the mode's once latency leaves room again.  checked
+ * every HUB12_ADAPT_PERIOD, see hub12fb_adapt_worker.
+ */
+#define HUB12_ADAPT_PERIOD	(HZ / 2)
+#define HUB12_ADAPT_SKIPS	64	/* more than 1 in this many, go down */
+#define HUB12_ADAPT_GOOD	4	/* quiet periods before going up */
+#define HUB12_ADAPT_MIN_REFRESH	25
+
+/* bits in hub12_par.state */
+#define HUB12_BACK_READY	0	/* back set converted, swap at vsync */
+
+/*
+ * counters since probe, in debugfs/hub12fb-<spi dev>/.  each is only
+ * written from one place (hsync timer, spi completion or the worker),
+ * readers get what they get.  latency is hsync submit to the last
+ * output done, bucket b is [2^(b-1), 2^b) us, the last one everything
+ * longer.
+ */
+#define HUB12_LAT_BUCKETS	16
+
+struct hub12_stats {
+	u32				lines;		/* shifted out */
+	u32				skipped;	/* still shifting at hsync */
+	u32				frames;
+	u32				converts;
+	u64				convert_ns;	/* total */
+	u32				convert_max_us;
+	u32				latency_max_us;
+	u64				latency_sum_us;
+	u32				latency[HUB12_LAT_BUCKETS];
+};
+
+/* framebuffer rows changed since a set was last converted, y1 == y2 none */
+struct hub12_dirty {
+	u16				y1, y2;
+};
+
 struct hub12_par {
 	struct hub12fb_platform_data	pdata;
 	struct spi_device *		spi;
 	struct fb_info *		info;
 	void *				fb_buffer;
+	dma_addr_t			fb_dma;	/* wire order only */
 	size_t				bsize;
-	void *				hsync_buf[4];
-	dma_addr_t			hsync_dma[4];
+	void *				hsync_buf[HSYNC_SETS][HUB12_MAX_SLOTS];
+	dma_addr_t			hsync_dma[HSYNC_SETS][HUB12_MAX_SLOTS];
 	unsigned			hsync_length;
-	struct spi_message		message;
-	struct spi_transfer		transfer;
+	int				front;	/* set being shifted */
+	unsigned long			state;
+	struct work_struct		convert_work;
+	spinlock_t			dirty_lock;
+	struct hub12_dirty		dirty[HSYNC_SETS];
+	struct fb_deferred_io		defio;
+	int (*defio_mmap)(struct fb_info *, struct vm_area_struct *);
+	struct vm_operations_struct	vm_ops;
+	atomic_t			mapped;	/* user mappings */
+	struct spi_device *		out[HUB12_MAX_OUTPUTS];
+	int				outputs;
+	unsigned			out_off[HUB12_MAX_OUTPUTS];
+	unsigned			out_len[HUB12_MAX_OUTPUTS];
+	atomic_t			pending;	/* outputs shifting */
+	struct spi_message		message[HSYNC_SETS][HUB12_MAX_SLOTS]
+					       [HUB12_MAX_OUTPUTS];
+	struct spi_transfer		transfer[HSYNC_SETS][HUB12_MAX_SLOTS]
+						[HUB12_MAX_OUTPUTS];
 	struct completion		hsync_done;
 	struct hrtimer			hsync_timer;
 	struct hrtimer			ledon_timer;
-	ktime_t				hsync_period;
-	ktime_t				ledon_period;
+	ktime_t				hsync_period;	/* a scan line */
+	ktime_t				slot_period[HUB12_MAX_PLANES];
+	ktime_t				ledon_period[HUB12_MAX_PLANES];
+	int				planes;	/* 1, or gray levels */
+	int				slots;	/* 4 * planes */
+	u8				gray_map[HUB12_MAX_PLANES][256];
 	int				hsync_timeout;
 	int				blank;
 	unsigned			running       :1;
+	unsigned			lsb_first     :1; /* spi master can */
+	unsigned			wire          :1; /* fb in wire order */
+	unsigned			gray          :1; /* 8 bpp, planes */
+	unsigned			adaptive      :1; /* refresh follows spi */
 	int				i_scan;
+	int				i_plane;
+	ktime_t				submitted;	/* this line */
+	struct hub12_stats		stats;
+	struct dentry *			debugfs;
+	struct delayed_work		adapt_work;
+	u32				refresh;	/* of the mode */
+	u32				refresh_now;	/* running at */
+	u32				refresh_want;	/* taken at vsync */
+	u32				adaptations;
+	int				adapt_good;	/* quiet periods */
+	struct hub12_stats		adapt_last;	/* at the last check */
 	u32				pseudo_palette[16];
 };
 
@@ -121,6 +244,9 @@ static const u32 hub12fb_info_flags = FBINFO_DEFAULT | FBINFO_READS_FAST |
 static char *mode __devinitdata = NULL;
 static int spi[3] __devinitdata = {-1,0,HUB12_MAX_FREQ}; /* no default bus */
 static int gpio[4] __devinitdata = {-1,-1,-1,-1}; /* overrides if not -1 */
+static int spi_out[2 * (HUB12_MAX_OUTPUTS - 1)] __devinitdata;
+static int n_spi_out __devinitdata;	/* <bus>,<cs> pairs */
+static bool adaptive __devinitdata = 1;
 
 static u16 red2[]   __read_mostly = { 0x0000, 0xFFFF};
 static u16 green2[] __read_mostly = { 0x0000, 0x0000};
@@ -131,49 +257,6 @@ static const struct fb_cmap hub12fb_cmap_2_colors = {
 
 static const u8 palette_1bit[256] = {[0]=1,[1]=0};
 
-/*
- * def bitreverse(x):
- *     x = ((x & 0xaa)>>1) | ((x & 0x55)<<1)
- *     x = ((x & 0xcc)>>2) | ((x & 0x33)<<2)
- *     x = ((x & 0xf0)>>4) | ((x & 0x0f)<<4)
- *     return x
- */
-
-static const unsigned char bit_reverse_inverse[] = {
-	0xff, 0x7f, 0xbf, 0x3f, 0xdf, 0x5f, 0x9f, 0x1f,
-	0xef, 0x6f, 0xaf, 0x2f, 0xcf, 0x4f, 0x8f, 0x0f,
-	0xf7, 0x77, 0xb7, 0x37, 0xd7, 0x57, 0x97, 0x17,
-	0xe7, 0x67, 0xa7, 0x27, 0xc7, 0x47, 0x87, 0x07,
-	0xfb, 0x7b, 0xbb, 0x3b, 0xdb, 0x5b, 0x9b, 0x1b,
-	0xeb, 0x6b, 0xab, 0x2b, 0xcb, 0x4b, 0x8b, 0x0b,
-	0xf3, 0x73, 0xb3, 0x33, 0xd3, 0x53, 0x93, 0x13,
-	0xe3, 0x63, 0xa3, 0x23, 0xc3, 0x43, 0x83, 0x03,
-	0xfd, 0x7d, 0xbd, 0x3d, 0xdd, 0x5d, 0x9d, 0x1d,
-	0xed, 0x6d, 0xad, 0x2d, 0xcd, 0x4d, 0x8d, 0x0d,
-	0xf5, 0x75, 0xb5, 0x35, 0xd5, 0x55, 0x95, 0x15,
-	0xe5, 0x65, 0xa5, 0x25, 0xc5, 0x45, 0x85, 0x05,
-	0xf9, 0x79, 0xb9, 0x39, 0xd9, 0x59, 0x99, 0x19,
-	0xe9, 0x69, 0xa9, 0x29, 0xc9, 0x49, 0x89, 0x09,
-	0xf1, 0x71, 0xb1, 0x31, 0xd1, 0x51, 0x91, 0x11,
-	0xe1, 0x61, 0xa1, 0x21, 0xc1, 0x41, 0x81, 0x01,
-	0xfe, 0x7e, 0xbe, 0x3e, 0xde, 0x5e, 0x9e, 0x1e,
-	0xee, 0x6e, 0xae, 0x2e, 0xce, 0x4e, 0x8e, 0x0e,
-	0xf6, 0x76, 0xb6, 0x36, 0xd6, 0x56, 0x96, 0x16,
-	0xe6, 0x66, 0xa6, 0x26, 0xc6, 0x46, 0x86, 0x06,
-	0xfa, 0x7a, 0xba, 0x3a, 0xda, 0x5a, 0x9a, 0x1a,
-	0xea, 0x6a, 0xaa, 0x2a, 0xca, 0x4a, 0x8a, 0x0a,
-	0xf2, 0x72, 0xb2, 0x32, 0xd2, 0x52, 0x92, 0x12,
-	0xe2, 0x62, 0xa2, 0x22, 0xc2, 0x42, 0x82, 0x02,
-	0xfc, 0x7c, 0xbc, 0x3c, 0xdc, 0x5c, 0x9c, 0x1c,
-	0xec, 0x6c, 0xac, 0x2c, 0xcc, 0x4c, 0x8c, 0x0c,
-	0xf4, 0x74, 0xb4, 0x34, 0xd4, 0x54, 0x94, 0x14,
-	0xe4, 0x64, 0xa4, 0x24, 0xc4, 0x44, 0x84, 0x04,
-	0xf8, 0x78, 0xb8, 0x38, 0xd8, 0x58, 0x98, 0x18,
-	0xe8, 0x68, 0xa8, 0x28, 0xc8, 0x48, 0x88, 0x08,
-	0xf0, 0x70, 0xb0, 0x30, 0xd0, 0x50, 0x90, 0x10,
-	0xe0, 0x60, 0xa0, 0x20, 0xc0, 0x40, 0x80, 0x00
-};
-
 /* ---------------------------------------------------------------------------
  * Backlight driver
  */
@@ -181,14 +264,35 @@ static const unsigned char bit_reverse_inverse[] = {
 static inline void hub12fb_set_brightness(struct hub12_par *par)
 {
 	u64 ns;
-
-	ns = par->pdata.brightness * ktime_to_ns(par->hsync_period) / 256;
+	int p;
 
 	/* should have some reasonable min and max here
 	 * and the change the run mode if you are outside those ranges...
 	 */
 
-	par->ledon_period = ns_to_ktime(ns);
+	/* each plane lights for the same share of its slot */
+	for (p=0; p<par->planes; p++) {
+		ns = par->pdata.brightness *
+		     ktime_to_ns(par->slot_period[p]) / 256;
+		par->ledon_period[p] = ns_to_ktime(ns);
+	}
+}
+
+/*
+ * plane p gets 2^p / (2^planes - 1) of the scan line, binary coded
+ * modulation.  one plane is the whole line.
+ */
+static void hub12fb_set_timings(struct hub12_par *par, u32 refresh)
+{
+	u64 line = NSEC_PER_SEC / refresh / 4;
+	u32 weights = (1 << par->planes) - 1;
+	int p;
+
+	par->hsync_period = ns_to_ktime(line);
+	for (p=0; p<par->planes; p++)
+		par->slot_period[p] = ns_to_ktime(div_u64(line << p, weights));
+
+	hub12fb_set_brightness(par);
 }
 
 #if CONFIG_FB_HUB12_BACKLIGHT
@@ -274,79 +378,352 @@ static void exit_hub12bl(struct fb_info *info)
  *  Framebuffer driver loop
  */
 
-/*
- * do_vsync breaks up the framebuffer into the
- * to data that will go over the wire to the shift registers.
- * individual displays are 32 w x 16 h with 4 scan lines, in 4 colums.
+static void convert_rows(struct hub12_par *par, int set, u16 y1, u16 y2)
+{
+	u16 j0 = y1 / 16, j1 = (y2 + 15) / 16;
+	s16 i, p;
+
+	/* the hsync buffers are the framebuffer */
+	if (par->wire)
+		return;
+
+	for(i=0;i<4;i++)
+		if (par->pdata.bpp == 1)
+			load_interlace_1bit(par->hsync_buf[set][i], par->fb_buffer,
+				i, par->pdata.width, j0, j1, !par->lsb_first);
+		else if (!par->gray)
+			load_interlace_8bit(par->hsync_buf[set][i],
+				par->fb_buffer, i, par->pdata.width,
+				j0, j1, palette_1bit, !par->lsb_first);
+		else
+			for (p=0; p<par->planes; p++)
+				load_interlace_8bit(
+					par->hsync_buf[set][i*par->planes + p],
+					par->fb_buffer, i, par->pdata.width,
+					j0, j1, par->gray_map[p],
+					!par->lsb_first);
+}
+
+/* the dma buffers are for the spi master's device, if it is set up for it */
+static inline struct device *hub12fb_dma_device(struct hub12_par *par)
+{
+	struct device *device = &par->spi->dev;
+
+	return device->coherent_dma_mask ? device : NULL;
+}
+
+/* ---------------------------------------------------------------------------
+ *  Dirty tracking
  *
- * many things to iterate over...
- *  i, 4 "scan lines"
- *  j, height / 16 "module rows"
- *  k, width / 8 "columes per row"
- *  l, 4 lines per column (per scanline, bottom up!)
+ * every way into the framebuffer marks the rows it changed, in both
+ * sets: mmap through deferred io (a page fault, then the pages at the
+ * next fb_deferred_io delay), write() and the drawing ops straight away.
+ * the worker converts only what its set has pending, so a static
+ * picture costs nothing but the refresh.
  */
 
-/* some spi masters can write lsb mode, so in the future
- * one could implement a different transfer mode
- * and not use the bit reverse table
+static void hub12fb_mark_dirty(struct hub12_par *par, u32 y, u32 h)
+{
+	unsigned long flags;
+	u16 y2;
+	int set;
+
+	if (y >= par->pdata.height || !h || par->wire)
+		return;
+	y2 = min_t(u32, y + h, par->pdata.height);
+
+	spin_lock_irqsave(&par->dirty_lock, flags);
+	for (set=0; set<HSYNC_SETS; set++) {
+		struct hub12_dirty *d = &par->dirty[set];
+
+		if (d->y1 == d->y2) {
+			d->y1 = y;
+			d->y2 = y2;
+		} else {
+			d->y1 = min_t(u16, d->y1, y);
+			d->y2 = max_t(u16, d->y2, y2);
+		}
+	}
+	spin_unlock_irqrestore(&par->dirty_lock, flags);
+}
+
+static void hub12fb_mark_all(struct hub12_par *par)
+{
+	hub12fb_mark_dirty(par, 0, par->pdata.height);
+}
+
+/* takes what a set has pending, false if nothing */
+static bool hub12fb_take_dirty(struct hub12_par *par, int set,
+			       struct hub12_dirty *d)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&par->dirty_lock, flags);
+	*d = par->dirty[set];
+	par->dirty[set].y1 = par->dirty[set].y2 = 0;
+	spin_unlock_irqrestore(&par->dirty_lock, flags);
+
+	return d->y1 != d->y2;
+}
+
+static bool hub12fb_is_dirty(struct hub12_par *par, int set)
+{
+	return ACCESS_ONCE(par->dirty[set].y1) !=
+	       ACCESS_ONCE(par->dirty[set].y2);
+}
+
+static void hub12fb_deferred_io(struct fb_info *info,
+				struct list_head *pagelist)
+{
+	struct hub12_par *par = info->par;
+	u32 line = info->fix.line_length;
+	struct page *page;
+	unsigned long start, end;
+
+	list_for_each_entry(page, pagelist, lru) {
+		start = page->index << PAGE_SHIFT;
+		end = start + PAGE_SIZE;
+		hub12fb_mark_dirty(par, start / line,
+				   DIV_ROUND_UP(end, line) - start / line);
+	}
+}
+
+static ssize_t hub12fb_write(struct fb_info *info, const char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	struct hub12_par *par = info->par;
+	u32 line = info->fix.line_length;
+	loff_t pos = *ppos;
+	ssize_t res;
+
+	res = fb_sys_write(info, buf, count, ppos);
+	if (res > 0)
+		hub12fb_mark_dirty(par, pos / line,
+				   (pos + res - 1) / line - pos / line + 1);
+	return res;
+}
+
+static void hub12fb_fillrect(struct fb_info *info,
+			     const struct fb_fillrect *rect)
+{
+	sys_fillrect(info, rect);
+	hub12fb_mark_dirty(info->par, rect->dy, rect->height);
+}
+
+static void hub12fb_copyarea(struct fb_info *info,
+			     const struct fb_copyarea *area)
+{
+	sys_copyarea(info, area);
+	hub12fb_mark_dirty(info->par, area->dy, area->height);
+}
+
+static void hub12fb_imageblit(struct fb_info *info,
+			      const struct fb_image *image)
+{
+	sys_imageblit(info, image);
+	hub12fb_mark_dirty(info->par, image->dy, image->height);
+}
+
+/*
+ * mmap hands out the framebuffer pages themselves, so a program draws
+ * into them with no system call per frame.  deferred io maps them a
+ * page at a time as they are touched and reports the written ones, we
+ * count the mappings: the pages can't be reallocated (a new mode) while
+ * anyone has them, see hub12fb_check_var.
  */
 
-#define CONVERT(byte)	bit_reverse_inverse[byte]
+static void hub12fb_vm_open(struct vm_area_struct *vma)
+{
+	struct fb_info *info = vma->vm_private_data;
+	struct hub12_par *par = info->par;
+
+	atomic_inc(&par->mapped);
+}
 
-static void inline load_interlace_1bit(u8 *lb, u8 *fb, u8 lace,
-					u16 width, u16 height)
+static void hub12fb_vm_close(struct vm_area_struct *vma)
 {
-	int j, k, l, rowbytes = width/8;
-	/*
-	* iterates in direction of output stream...
-	* copy the data, 8 pixel byte by byte, need bitswap for SPI
-	* (lsb first spi driver is rare)
-	*/
+	struct fb_info *info = vma->vm_private_data;
+	struct hub12_par *par = info->par;
+
+	atomic_dec(&par->mapped);
+}
+
+static int hub12fb_mmap(struct fb_info *info, struct vm_area_struct *vma)
+{
+	struct hub12_par *par = info->par;
+	unsigned long pages = PAGE_ALIGN(info->fix.smem_len) >> PAGE_SHIFT;
+	int retval;
+
+	/* fb_mmap() leaves the bounds to us */
+	if (vma->vm_pgoff >= pages ||
+	    vma_pages(vma) > pages - vma->vm_pgoff)
+		return -EINVAL;
+
+	if (par->wire) {
+		/* dma memory, mapped whole, nothing to track */
+		DEFINE_DMA_ATTRS(attrs);
+		dma_set_attr(DMA_ATTR_WRITE_COMBINE, &attrs);
+
+		retval = dma_mmap_attrs(hub12fb_dma_device(par), vma,
+					par->fb_buffer, par->fb_dma,
+					par->bsize, &attrs);
+		if (retval)
+			return retval;
+
+		memset(&par->vm_ops, 0, sizeof(par->vm_ops));
+		vma->vm_private_data = info;
+	} else {
+		retval = par->defio_mmap(info, vma);
+		if (retval)
+			return retval;
+
+		/* its fault and write tracking */
+		par->vm_ops = *vma->vm_ops;
+	}
 
-	for (j=0; j<height/16; j++)
-		for (k=0; k<rowbytes; k++)
-			for (l=3; l>=0; l--)
-				*lb++ = CONVERT(fb[rowbytes*(j*16+l*4+lace) + k]);
+	/* our open and close */
+	par->vm_ops.open = hub12fb_vm_open;
+	par->vm_ops.close = hub12fb_vm_close;
+	vma->vm_ops = &par->vm_ops;
+
+	atomic_inc(&par->mapped);
+	return 0;
 }
 
+/*
+ * deferred io clears the mapping of every page from smem_start on.  a
+ * wire order buffer is dma memory it never faulted in, and smem_start
+ * is its bus address then, not a physical one, so leave it alone.
+ */
+static void hub12fb_defio_cleanup(struct fb_info *info)
+{
+	struct hub12_par *par = info->par;
 
+	if (par->wire) {
+		cancel_delayed_work_sync(&info->deferred_work);
+		return;
+	}
+	fb_deferred_io_cleanup(info);
+}
 
-static void inline load_interlace_pseudo_8bit(u8 *lb, u8 *fb, u8 lace,
-					 u16 width, u16 height, const u8 *palette)
+/*
+ * the conversion runs in a worker, into the set that isn't shifting.
+ * the last scanline of a frame swaps it in, so the completion
+ * callback never does more than flip an index.
+ *
+ * only one of these runs at a time, and it leaves a converted set
+ * alone until it has been swapped in.
+ */
+static void convert_worker(struct work_struct *work)
 {
-	int j, k, l, rowbytes= width/8;
-	u8 *px;
-	u8 byte;
-	/* same loop as 1 bit, but build byte from 8 pixels with palette */
+	struct hub12_par *par = container_of(work, struct hub12_par,
+					     convert_work);
 
-	for (j=0; j<height/16; j++)
-		for (k=0; k<rowbytes; k++)
-			for (l=3; l>=0; l--) {
-				px = fb + width * (j*16+l*4+lace) + k*8;
-				byte  = palette[*px++] << 7;
-				byte |= palette[*px++] << 6;
-				byte |= palette[*px++] << 5;
-				byte |= palette[*px++] << 4;
-				byte |= palette[*px++] << 3;
-				byte |= palette[*px++] << 2;
-				byte |= palette[*px++] << 1;
-				byte |= palette[*px++];
-				*lb++ = byte;
-			}
+	int back = !par->front;
+	struct hub12_dirty d;
+	ktime_t start;
+	s64 ns;
+
+	/* queued by a shift that finished after the stop */
+	if (!par->running || test_bit(HUB12_BACK_READY, &par->state))
+		return;
+
+	if (!hub12fb_take_dirty(par, back, &d))
+		return;
+	start = ktime_get();
+	convert_rows(par, back, d.y1, d.y2);
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	par->stats.converts++;
+	par->stats.convert_ns += ns;
+	if (ns > (s64) par->stats.convert_max_us * 1000)
+		par->stats.convert_max_us = div_u64(ns, 1000);
+
+	/* buffers written before the swap can see them */
+	smp_wmb();
+	set_bit(HUB12_BACK_READY, &par->state);
+}
+
+/* the shortest slot, the lsb plane's, at a refresh */
+static u32 hub12fb_lsb_slot_us(struct hub12_par *par, u32 refresh)
+{
+	return USEC_PER_SEC / (4 * refresh * ((1 << par->planes) - 1));
+}
+
+/*
+ * down when lines are skipped, or the mean latency is more than the lsb
+ * slot so they are about to be.  up when it has been quiet a while and
+ * the latency would fit the faster slots with HUB12_SHIFT_MARGIN.
+ */
+static void hub12fb_adapt_worker(struct work_struct *work)
+{
+	struct hub12_par *par = container_of(to_delayed_work(work),
+					     struct hub12_par, adapt_work);
+	struct hub12_stats *st = &par->stats;
+	struct hub12_stats *last = &par->adapt_last;
+	u32 lines = st->lines - last->lines;
+	u32 skipped = st->skipped - last->skipped;
+	u64 sum = st->latency_sum_us - last->latency_sum_us;
+	u32 refresh = par->refresh_now;
+	u32 want = refresh;
+	u32 mean, up;
+
+	last->lines = st->lines;
+	last->skipped = st->skipped;
+	last->latency_sum_us = st->latency_sum_us;
+
+	if (!par->adaptive) {
+		want = par->refresh;
+	} else if (lines || skipped) {
+		mean = lines ? div_u64(sum, lines) : 0;
+		if (skipped * HUB12_ADAPT_SKIPS > lines + skipped ||
+		    mean > hub12fb_lsb_slot_us(par, refresh)) {
+			if (refresh > HUB12_ADAPT_MIN_REFRESH)
+				want = max_t(u32, refresh * 3 / 4,
+					     HUB12_ADAPT_MIN_REFRESH);
+			par->adapt_good = 0;
+		} else if (refresh < par->refresh &&
+			   ++par->adapt_good >= HUB12_ADAPT_GOOD) {
+			up = min_t(u32, refresh * 5 / 4 + 1, par->refresh);
+			if (mean * HUB12_SHIFT_MARGIN <=
+			    hub12fb_lsb_slot_us(par, up))
+				want = up;
+			par->adapt_good = 0;
+		}
+	}
+
+	if (want != par->refresh_want) {
+		dev_dbg(&par->spi->dev, "refresh %u -> %u hz, %u of %u lines"
+			" skipped\n", refresh, want, skipped, lines + skipped);
+		/* stopping waits for a line at the slower of the two */
+		par->hsync_timeout = (HZ/4) / min(want, refresh) + 1;
+		par->refresh_want = want;
+		if (par->adaptive)
+			par->adaptations++;
+	}
+
+	if (par->running)
+		schedule_delayed_work(&par->adapt_work, HUB12_ADAPT_PERIOD);
 }
 
 static void do_vsync(struct hub12_par *par)
 {
-	s16 i;
+	/* all four lines of the front set are out, it is free now */
+	if (test_and_clear_bit(HUB12_BACK_READY, &par->state))
+		par->front = !par->front;
 
-	for(i=0;i<4;i++)
-		if (par->pdata.bpp == 1)
-			load_interlace_1bit(par->hsync_buf[i], par->fb_buffer, i,
-				par->pdata.width, par->pdata.height);
-		else
-			load_interlace_pseudo_8bit(par->hsync_buf[i], par->fb_buffer, i,
-				par->pdata.width, par->pdata.height, palette_1bit);
 	par->i_scan = 0;
+	par->stats.frames++;
+
+	/* a new refresh starts with a frame, ledon scales with the slots */
+	if (par->refresh_want != par->refresh_now) {
+		par->refresh_now = par->refresh_want;
+		hub12fb_set_timings(par, par->refresh_now);
+	}
+
+	/* stopping cancels the worker, don't queue it again after that */
+	if (par->running && hub12fb_is_dirty(par, !par->front))
+		queue_work(system_highpri_wq, &par->convert_work);
 }
 
 static void shift_scanline_completion(void *context)
@@ -357,6 +734,19 @@ static void shift_scanline_completion(void *context)
 	static const int bvals[4] = {0,0,1,1};
 
 	struct hub12_par *par = (struct hub12_par *) context;
+	u32 us;
+
+	/* the last output to finish latches them all */
+	if (!atomic_dec_and_test(&par->pending))
+		return;
+
+	us = ktime_us_delta(ktime_get(), par->submitted);
+	par->stats.lines++;
+	par->stats.latency[min(fls(us), HUB12_LAT_BUCKETS - 1)]++;
+	par->stats.latency_sum_us += us;
+	if (us > par->stats.latency_max_us)
+		par->stats.latency_max_us = us;
+	trace_hub12fb_hsync_done(par->i_scan, par->i_plane, us);
 
 	/* bits have been shifted.. now lets enable the proper output */
 	/* move them to the output */
@@ -368,11 +758,16 @@ static void shift_scanline_completion(void *context)
 	if (par->blank == FB_BLANK_UNBLANK && par->running) {
 		/* turn on the light */
 		gpio_set_value(par->pdata.gpio.enable, 1);
-		hrtimer_start(&par->ledon_timer, par->ledon_period,
-				HRTIMER_MODE_REL);
+		hrtimer_start(&par->ledon_timer,
+			      par->ledon_period[par->i_plane],
+			      HRTIMER_MODE_REL);
 	}
 
-	par->i_scan++;
+	/* every plane of a line, then the next line */
+	if (++par->i_plane == par->planes) {
+		par->i_plane = 0;
+		par->i_scan++;
+	}
 
 	if (par->i_scan == 4) 	/* do the vsync now */
 		do_vsync(par);
@@ -381,30 +776,58 @@ static void shift_scanline_completion(void *context)
 }
 
 
+/*
+ * the spi message of every scan line of both sets is built once, after
+ * the buffers are (re)allocated, so an hsync only hands one over.  when
+ * the buffers were allocated for a dma capable device their handles are
+ * good, and the master doesn't map them again.  without one it has to.
+ * with more outputs, one message each for its band of module rows.  an
+ * output on another master maps its band itself, the handles are for
+ * ours.
+ */
 static void setup_hsync(struct hub12_par *par)
 {
-	/* setup the spi transfer
-	 * we don't have to do this every time
-	 * just after we change settings
-	 */
-
-	struct spi_message *m = &par->message;
-	struct spi_transfer *t = &par->transfer;
-
-	t->rx_buf = NULL;
-	t->rx_dma = 0;
-	t->len    = par->hsync_length;
-
-	t->cs_change		= 1;
-	t->bits_per_word	= 8;
-	t->delay_usecs		= 0;
-	t->speed_hz		= 0; /* default */
-
-	spi_message_init(m);
-	spi_message_add_tail(t,m);
+	struct spi_message *m;
+	struct spi_transfer *t;
+	unsigned band = par->pdata.width / 8 * 4; /* a module row, a line */
+	int rows = par->pdata.height / 16;
+	int mapped = hub12fb_dma_device(par) != NULL;
+	int set, i, o;
+
+	for (o=0; o<par->outputs; o++) {
+		par->out_off[o] = band * (rows * o / par->outputs);
+		par->out_len[o] = band * (rows * (o + 1) / par->outputs) -
+				  par->out_off[o];
+	}
 
-	m->context = par;
-	m->complete = shift_scanline_completion;
+	for (set=0; set<HSYNC_SETS; set++)
+		for (i=0; i<par->slots; i++)
+			for (o=0; o<par->outputs; o++) {
+				m = &par->message[set][i][o];
+				t = &par->transfer[set][i][o];
+
+				memset(t, 0, sizeof(*t));
+				t->tx_buf = par->hsync_buf[set][i] +
+					    par->out_off[o];
+				t->tx_dma = par->hsync_dma[set][i] +
+					    par->out_off[o];
+				t->rx_buf = NULL;
+				t->rx_dma = 0;
+				t->len    = par->out_len[o];
+
+				t->cs_change		= 1;
+				t->bits_per_word	= 8;
+				t->delay_usecs		= 0;
+				t->speed_hz		= 0; /* default */
+
+				spi_message_init(m);
+				spi_message_add_tail(t,m);
+
+				m->is_dma_mapped = mapped &&
+					par->out[o]->master == par->spi->master;
+				m->context = par;
+				m->complete = shift_scanline_completion;
+			}
 
 	/* mark our completion done so we can start again */
 	init_completion(&par->hsync_done);
@@ -413,14 +836,26 @@ static void setup_hsync(struct hub12_par *par)
 
 static void shift_scanline_start(struct hub12_par *par)
 {
-	struct spi_message *m = &par->message;
-	struct spi_transfer *t = &par->transfer;
-
-	t->tx_buf = par->hsync_buf[par->i_scan];
-	t->tx_dma = par->hsync_dma[par->i_scan];
-
-	/* only our driver until we can latch */
-	spi_async_locked(par->spi, m);
+	int slot = par->i_scan * par->planes + par->i_plane;
+	int o, outputs = 0;
+
+	/* more outputs than module rows leaves some without a band */
+	for (o=0; o<par->outputs; o++)
+		if (par->out_len[o])
+			outputs++;
+	atomic_set(&par->pending, outputs);
+
+	trace_hub12fb_hsync_start(par->front, par->i_scan, par->i_plane);
+	par->submitted = ktime_get();
+
+	/* only our driver until we can latch.  one that didn't go counts
+	 * as done, or the line would never latch and every hsync after it
+	 * would be skipped */
+	for (o=0; o<par->outputs; o++)
+		if (par->out_len[o] &&
+		    spi_async_locked(par->out[o],
+				     &par->message[par->front][slot][o]))
+			shift_scanline_completion(par);
 }
 
 
@@ -440,6 +875,9 @@ static enum hrtimer_restart do_hsync(struct hrtimer *timer)
 {
 	struct hub12_par *par = container_of(timer,
 					     struct hub12_par, hsync_timer);
+	/* the slot of the plane going out now */
+	ktime_t period = par->slot_period[par->i_plane];
+
 	/* turn off the latch */
 	gpio_set_value(par->pdata.gpio.latch, 0);
 
@@ -459,13 +897,18 @@ static enum hrtimer_restart do_hsync(struct hrtimer *timer)
 	 * if last hsync was complete, eat the done and start anew
 	 */
 
-	if (try_wait_for_completion(&par->hsync_done))
+	if (try_wait_for_completion(&par->hsync_done)) {
 		shift_scanline_start(par);
+	} else {
+		par->stats.skipped++;
+		trace_hub12fb_hsync_skip(par->i_scan, par->i_plane,
+					 par->stats.skipped);
+	}
 
 	/* really shift it forward */
-	hrtimer_add_expires(timer, par->hsync_period);
+	hrtimer_add_expires(timer, period);
 	/* in case it fell to far behind */
-	hrtimer_forward_now(timer, par->hsync_period);
+	hrtimer_forward_now(timer, period);
 	return HRTIMER_RESTART;
 }
 
@@ -475,6 +918,9 @@ static void hub12fb_stop_running(struct hub12_par *par)
 		return;
 
 	par->running = 0;
+	/* the refresh stays as it was until started again */
+	cancel_delayed_work_sync(&par->adapt_work);
+
 	/* will sleep until hsync is stopped */
 	hrtimer_cancel(&par->hsync_timer);
 
@@ -482,6 +928,10 @@ static void hub12fb_stop_running(struct hub12_par *par)
 	wait_for_completion_interruptible_timeout(&par->hsync_done,
 						  par->hsync_timeout);
 
+	/* nothing left to convert for.  a shift that outlived the wait
+	 * above sees running clear and doesn't queue it again */
+	cancel_work_sync(&par->convert_work);
+
 	/* lets also make sure the enable is off */
 	hrtimer_cancel(&par->ledon_timer);
 	gpio_set_value(par->pdata.gpio.enable, 0);
@@ -495,15 +945,26 @@ static void hub12fb_stop_running(struct hub12_par *par)
 
 static void hub12fb_start_running(struct hub12_par *par)
 {
+	struct hub12_dirty d;
+
 	if (par->running)
 		return;
 
-	/* begin with vsync */
-	do_vsync(par);
+	/* begin with a converted frame, the worker does the back set */
+	hub12fb_mark_all(par);
+	hub12fb_take_dirty(par, par->front, &d);
+	convert_rows(par, par->front, 0, par->pdata.height);
+	clear_bit(HUB12_BACK_READY, &par->state);
+	par->i_scan = 0;
+	par->i_plane = 0;
 	setup_hsync(par);
 
 	par->running = 1;
 	hrtimer_start(&par->hsync_timer, par->hsync_period, HRTIMER_MODE_REL);
+
+	par->adapt_last = par->stats;
+	par->adapt_good = 0;
+	schedule_delayed_work(&par->adapt_work, HUB12_ADAPT_PERIOD);
 }
 
 static inline u32 refresh_to_pixclock(int refresh, struct fb_var_screeninfo *var)
@@ -520,6 +981,42 @@ static inline u32 hub12fb_refresh_rate(struct fb_var_screeninfo *var)
 	return refresh;
 }
 
+/*
+ * the fastest refresh with this many planes: the lsb slot, a 2^planes - 1
+ * part of a line, has to fit shifting the line out (of the output with
+ * the most module rows), with a margin for the master.  never more than
+ * 1000 hz.
+ */
+static u32 hub12fb_max_refresh(struct hub12_par *par,
+			       struct fb_var_screeninfo *var, int planes)
+{
+	u32 hz = par->spi->max_speed_hz ? par->spi->max_speed_hz :
+					  HUB12_MAX_FREQ;
+	/* the outputs shift at once, the one with the most rows counts */
+	u32 rows = DIV_ROUND_UP(var->yres / 16, par->outputs);
+	u32 bits = var->xres * rows * 16 / 4;
+	u32 refresh;
+
+	refresh = hz / (HUB12_SHIFT_MARGIN * bits * 4 * ((1 << planes) - 1));
+	return clamp_t(u32, refresh, 1, 1000);
+}
+
+/* after check_var */
+static inline int hub12fb_var_planes(struct fb_var_screeninfo *var)
+{
+	return var->grayscale ? var->red.length : 1;
+}
+
+/* pixel value to the output bit of each plane, 1 is dark */
+static void hub12fb_set_gray_maps(struct hub12_par *par)
+{
+	int p, v;
+
+	for (p=0; p<par->planes; p++)
+		for (v=0; v<256; v++)
+			par->gray_map[p][v] =
+				!((v >> (8 - par->planes + p)) & 1);
+}
 
 /**
  *      hub12fb_check_var - Validates a var passed in.
@@ -529,6 +1026,10 @@ static inline u32 hub12fb_refresh_rate(struct fb_var_screeninfo *var)
  */
 static int hub12fb_check_var(struct fb_var_screeninfo *var, struct fb_info *info)
 {
+	struct hub12_par *par = info->par;
+	u32 max_refresh;
+	int planes;
+
 	if (!var->xres)
 		var->xres = 1;
 	if (!var->yres)
@@ -538,10 +1039,6 @@ static int hub12fb_check_var(struct fb_var_screeninfo *var, struct fb_info *info
 	var->xres = ((var->xres + 31) / 32) * 32;
 	var->yres = ((var->yres + 15) / 16) * 16;
 
-	/* limit refresh to 1000 hz */
-	if (var->pixclock < refresh_to_pixclock(1000,var))
-		var->pixclock = refresh_to_pixclock(1000, var);
-
 	/* don't try "virtual" */
 	var->xres_virtual = var->xres;
 	var->yres_virtual = var->yres;
@@ -556,14 +1053,34 @@ static int hub12fb_check_var(struct fb_var_screeninfo *var, struct fb_info *info
 	var->left_margin  = 0;
 	var->right_margin = 0;
 
+	/* 2 to 4 bits, or 8 bit grayscale of that many: gray levels */
+	planes = 1;
+	if (var->bits_per_pixel >= 2 &&
+	    var->bits_per_pixel <= HUB12_MAX_PLANES)
+		planes = var->bits_per_pixel;
+	else if (var->bits_per_pixel == 8 && var->grayscale == 1)
+		planes = var->red.length >= 2 &&
+			 var->red.length <= HUB12_MAX_PLANES ?
+			 var->red.length : HUB12_MAX_PLANES;
+
 	if (var->bits_per_pixel > 1)
 		var->bits_per_pixel = 8;
 	else
 		var->bits_per_pixel = 1;
 
+	/* the refresh budget, gray levels go before the refresh does */
+	while (planes > 1 &&
+	       hub12fb_max_refresh(par, var, planes) < HUB12_MIN_REFRESH)
+		planes--;
+	max_refresh = hub12fb_max_refresh(par, var, planes);
+	if (var->pixclock < refresh_to_pixclock(max_refresh, var))
+		var->pixclock = refresh_to_pixclock(max_refresh, var);
+
+	var->grayscale = planes > 1;
+
 	var->vmode = FB_VMODE_NONINTERLACED;
 
-	/* in future, allow longer length palette in 8 bit mode */
+	/* 8 bit is the pseudo color threshold, or grayscale in the top bits */
 	switch (var->bits_per_pixel) {
 		case 1:
 			var->red.offset = 0;
@@ -576,14 +1093,19 @@ static int hub12fb_check_var(struct fb_var_screeninfo *var, struct fb_info *info
 			var->transp.length = 0;
 			break;
 		case 8:
-			var->red.offset = 0;
-			var->red.length = 1;
-			var->green.offset = 0;
-			var->green.length = 1;
-			var->blue.offset = 0;
-			var->blue.length = 1;
+			/* the top bits of a byte are the level */
+			var->red.offset = 8 - planes;
+			var->red.length = planes;
+			var->green = var->red;
+			var->blue = var->red;
 			var->transp.offset = 0;
 			var->transp.length = 0;
+			if (!var->grayscale) {
+				/* pseudo color */
+				var->red.offset = 0;
+				var->green.offset = 0;
+				var->blue.offset = 0;
+			}
 			break;
 	}
 	var->red.msb_right = 0;
@@ -591,13 +1113,24 @@ static int hub12fb_check_var(struct fb_var_screeninfo *var, struct fb_info *info
 	var->blue.msb_right = 0;
 	var->transp.msb_right = 0;
 
+	/* wire order is all or nothing */
+	if (var->nonstd != HUB12FB_NONSTD_WIRE || var->bits_per_pixel != 1 ||
+	    !par->lsb_first)
+		var->nonstd = 0;
+
+	/* a new size or depth needs new pages, not while they are mapped */
+	if (par->fb_buffer && atomic_read(&par->mapped) &&
+	    (var->xres != par->pdata.width || var->yres != par->pdata.height ||
+	     var->bits_per_pixel != par->pdata.bpp ||
+	     !var->nonstd != !par->wire || planes != par->planes))
+		return -EBUSY;
 
 	return 0;
 }
 
 static void hub12fb_free_buffers(struct hub12_par *par)
 {
-	int i;
+	int i, set;
 	struct device *device = &par->spi->dev;
 
 	DEFINE_DMA_ATTRS(attrs);
@@ -609,16 +1142,34 @@ static void hub12fb_free_buffers(struct hub12_par *par)
 	if (!device->coherent_dma_mask)
 		device = NULL;
 
-	for (i=0; i<4; i++) {
-		if (par->hsync_dma[i])
-			dma_free_attrs(device, par->hsync_length, par->hsync_buf[i],
-				       par->hsync_dma[i], &attrs);
+	for (set=0; set<HSYNC_SETS; set++)
+		for (i=0; i<HUB12_MAX_SLOTS; i++) {
+			/* slices of the framebuffer in wire order */
+			if (par->hsync_dma[set][i] && !par->wire)
+				dma_free_attrs(device, par->hsync_length,
+					       par->hsync_buf[set][i],
+					       par->hsync_dma[set][i], &attrs);
 
-		par->hsync_buf[i] = NULL;
-		par->hsync_dma[i] = 0;
-	}
+			par->hsync_buf[set][i] = NULL;
+			par->hsync_dma[set][i] = 0;
+		}
+
+	if (par->fb_buffer && par->wire) {
+		dma_free_attrs(device, par->bsize, par->fb_buffer,
+			       par->fb_dma, &attrs);
+		par->fb_buffer = NULL;
+		par->fb_dma = 0;
+	} else if (par->fb_buffer) {
+		unsigned long off;
+
+		/* run the deferred io still pending, it takes the written
+		 * pages off its list, which links them through page->lru */
+		flush_delayed_work(&par->info->deferred_work);
+
+		/* it leaves its mapping on the pages it faulted in */
+		for (off = 0; off < par->bsize; off += PAGE_SIZE)
+			virt_to_page(par->fb_buffer + off)->mapping = NULL;
 
-	if (par->fb_buffer) {
 		free_pages_exact(par->fb_buffer, par->bsize);
 		par->fb_buffer = NULL;
 	}
@@ -627,7 +1178,7 @@ static void hub12fb_free_buffers(struct hub12_par *par)
 static int hub12fb_allocate_buffers(struct fb_info *info){
 	struct hub12_par *par = info->par;
 	struct fb_fix_screeninfo *fix = &info->fix;
-	int i;
+	int i, set;
 	struct device *device = &par->spi->dev;
 	DEFINE_DMA_ATTRS(attrs);
 	dma_addr_t dma_handle = 0;
@@ -650,38 +1201,60 @@ static int hub12fb_allocate_buffers(struct fb_info *info){
 
 	//par->bsize = ((par->pdata.height * fix->line_length)/PAGE_SIZE + 1) * PAGE_SIZE;
 	par->bsize = PAGE_ALIGN(par->pdata.height * fix->line_length);
+	par->wire = info->var.nonstd == HUB12FB_NONSTD_WIRE;
 
-	/* page aligned memory of at least bsize length */
-	p = alloc_pages_exact(par->bsize, GFP_DMA | __GFP_ZERO);
-	if (!p)
-		return -ENOMEM;
+	if (par->wire) {
+		/* dma memory, the transfers go straight out of it */
+		p = dma_alloc_attrs(device, par->bsize, &par->fb_dma,
+				    GFP_KERNEL, &attrs);
+		if (!p)
+			return -ENOMEM;
+
+		/* all dark */
+		memset(p,0xff,par->bsize);
+	} else {
+		/* page aligned memory of at least bsize length */
+		p = alloc_pages_exact(par->bsize, GFP_DMA | __GFP_ZERO);
+		if (!p)
+			return -ENOMEM;
 
-	memset(p,0,par->bsize);
+		memset(p,0,par->bsize);
+	}
 
 	/* set buffers now to fb device */
 	par->fb_buffer    = p;
 	info->screen_base = p;
 
-	fix->smem_start   = (unsigned long) p;
-	//fix->smem_start   = virt_to_phys(p);
+	/* physical, deferred io finds the pages to map from it.  a wire
+	 * order buffer has no deferred io, see hub12fb_defio_cleanup() */
+	fix->smem_start   = par->wire ? par->fb_dma : virt_to_phys(p);
 	fix->smem_len     = par->bsize;
 
 	/* Report alloc memory info! */
-	printk("framebuffer: kernel=0x%p, smem=0x%p, len=0x%x\n",
-		p, (void *)fix->smem_start, fix->smem_len);
+	printk("framebuffer: kernel=0x%p, smem=0x%lx, len=0x%x\n",
+		p, fix->smem_start, fix->smem_len);
 
 	par->hsync_length = (par->pdata.width/8) * par->pdata.height / 4;
 
-	for (i=0; i<4; i++) {
-		p = dma_alloc_attrs(device, par->hsync_length,
-				    &dma_handle, GFP_KERNEL, &attrs);
+	for (set=0; set<HSYNC_SETS; set++)
+		for (i=0; i<par->slots; i++) {
+			if (par->wire) {
+				par->hsync_buf[set][i] = par->fb_buffer +
+							 i * par->hsync_length;
+				par->hsync_dma[set][i] = par->fb_dma +
+							 i * par->hsync_length;
+				continue;
+			}
 
-		if (!p)
-			goto cleanup_buffers;
+			p = dma_alloc_attrs(device, par->hsync_length,
+					    &dma_handle, GFP_KERNEL, &attrs);
 
-		par->hsync_buf[i] = p;
-		par->hsync_dma[i] = dma_handle;
-	}
+			if (!p)
+				goto cleanup_buffers;
+
+			par->hsync_buf[set][i] = p;
+			par->hsync_dma[set][i] = dma_handle;
+		}
 
 	return 0;
 
@@ -715,6 +1288,7 @@ static int hub12fb_set_par(struct fb_info *info)
 	struct hub12_par *par = info->par;
 	struct fb_fix_screeninfo *fix = &info->fix;
 	struct fb_var_screeninfo *var = &info->var;
+	int planes = hub12fb_var_planes(var);
 
 	/* before we do anything... lets stop the current framebuffer */
 
@@ -722,12 +1296,19 @@ static int hub12fb_set_par(struct fb_info *info)
 	/* clear old buffers if size or depth change */
 	if (par->fb_buffer && ( par->pdata.width  != var->xres ||
 				par->pdata.height != var->yres ||
-				par->pdata.bpp    != var->bits_per_pixel ))
+				par->pdata.bpp    != var->bits_per_pixel ||
+				!par->wire        != !var->nonstd ||
+				par->planes       != planes ))
 		hub12fb_free_buffers(par);
 
 	par->pdata.width  = var->xres;
 	par->pdata.height = var->yres;
 	par->pdata.bpp    = var->bits_per_pixel;
+	par->planes       = planes;
+	par->slots        = 4 * planes;
+	par->gray         = var->grayscale;
+	if (par->gray)
+		hub12fb_set_gray_maps(par);
 
 	if (par->fb_buffer == NULL)
 		retval = hub12fb_allocate_buffers(info);
@@ -740,22 +1321,25 @@ static int hub12fb_set_par(struct fb_info *info)
 	/* set fix based on var */
 	if (var->bits_per_pixel == 1)
 		fix->visual = FB_VISUAL_MONO10;
+	else if (par->gray)
+		fix->visual = FB_VISUAL_TRUECOLOR;
 	else
 		fix->visual = FB_VISUAL_STATIC_PSEUDOCOLOR;
 
 
-	/* set timings */
-	par->hsync_period = ns_to_ktime((NSEC_PER_SEC /
-					 hub12fb_refresh_rate(&info->var))/4);
-
-	par->hsync_timeout = (HZ/4) / hub12fb_refresh_rate(&info->var) + 1;
+	/* set timings, a new mode starts at its own refresh */
+	par->refresh      = hub12fb_refresh_rate(&info->var);
+	par->refresh_now  = par->refresh;
+	par->refresh_want = par->refresh;
+	hub12fb_set_timings(par, par->refresh);
 
-	hub12fb_set_brightness(par);
+	par->hsync_timeout = (HZ/4) / par->refresh + 1;
 
 	printk(KERN_ALERT DRIVER_NAME
-	       " timings (usec) hsync: %lld, led: %lld, hsync timeout: %ld\n",
+	       " timings (usec) hsync: %lld, led: %lld, planes: %d,"
+	       " hsync timeout: %ld\n",
 	       ktime_to_us(par->hsync_period),
-	       ktime_to_us(par->ledon_period),
+	       ktime_to_us(par->ledon_period[par->planes - 1]), par->planes,
 	       (long) jiffies_to_usecs(par->hsync_timeout));
 
 	info->flags = hub12fb_info_flags;
@@ -807,10 +1391,10 @@ static struct fb_ops hub12fb_ops = {
 	.fb_set_par	= hub12fb_set_par,
 	.fb_blank	= hub12fb_blank,
 	.fb_read	= fb_sys_read,
-	.fb_write	= fb_sys_write,
-	.fb_fillrect	= sys_fillrect,
-	.fb_copyarea	= sys_copyarea,
-	.fb_imageblit	= sys_imageblit,
+	.fb_write	= hub12fb_write,
+	.fb_fillrect	= hub12fb_fillrect,
+	.fb_copyarea	= hub12fb_copyarea,
+	.fb_imageblit	= hub12fb_imageblit,
 };
 
 /* -------------------------------------------------------------------------
@@ -894,6 +1478,196 @@ done:
 	return 0;
 }
 
+/*
+ * sysfs, on the spi device: refresh it runs at now, how often that was
+ * changed, and adaptive to turn it off (back to the mode's refresh).
+ */
+static ssize_t hub12fb_refresh_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct hub12_par *par = info->par;
+
+	return sprintf(buf, "%u\n", par->refresh_now);
+}
+
+static ssize_t hub12fb_adaptations_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct hub12_par *par = info->par;
+
+	return sprintf(buf, "%u\n", par->adaptations);
+}
+
+static ssize_t hub12fb_adaptive_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct hub12_par *par = info->par;
+
+	return sprintf(buf, "%u\n", par->adaptive);
+}
+
+static ssize_t hub12fb_adaptive_store(struct device *dev,
+				      struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct hub12_par *par = info->par;
+	unsigned val;
+	int retval;
+
+	retval = kstrtouint(buf, 0, &val);
+	if (retval)
+		return retval;
+
+	/* the worker takes it back to the mode's refresh */
+	par->adaptive = !!val;
+	return count;
+}
+
+static DEVICE_ATTR(refresh, S_IRUGO, hub12fb_refresh_show, NULL);
+static DEVICE_ATTR(adaptations, S_IRUGO, hub12fb_adaptations_show, NULL);
+static DEVICE_ATTR(adaptive, S_IRUGO | S_IWUSR, hub12fb_adaptive_show,
+		   hub12fb_adaptive_store);
+
+static struct attribute *hub12fb_attrs[] = {
+	&dev_attr_refresh.attr,
+	&dev_attr_adaptations.attr,
+	&dev_attr_adaptive.attr,
+	NULL,
+};
+
+static const struct attribute_group hub12fb_attr_group = {
+	.attrs = hub12fb_attrs,
+};
+
+static int hub12fb_latency_show(struct seq_file *m, void *v)
+{
+	struct hub12_par *par = m->private;
+	struct hub12_stats *st = &par->stats;
+	int b;
+
+	seq_printf(m, "us\tlines\n");
+	for (b=0; b<HUB12_LAT_BUCKETS - 1; b++)
+		seq_printf(m, "<%u\t%u\n", 1 << b, st->latency[b]);
+	seq_printf(m, ">=%u\t%u\n", 1 << (b - 1), st->latency[b]);
+	seq_printf(m, "max\t%u\n", st->latency_max_us);
+	return 0;
+}
+
+static int hub12fb_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hub12fb_latency_show, inode->i_private);
+}
+
+static const struct file_operations hub12fb_latency_fops = {
+	.owner		= THIS_MODULE,
+	.open		= hub12fb_latency_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* nothing here is needed to run, so failing is only a warning */
+static void __devinit hub12fb_debugfs_init(struct hub12_par *par)
+{
+	struct hub12_stats *st = &par->stats;
+	char name[32];
+	struct dentry *d;
+
+	snprintf(name, sizeof(name), DRIVER_NAME "-%s",
+		 dev_name(&par->spi->dev));
+	d = debugfs_create_dir(name, NULL);
+	if (IS_ERR_OR_NULL(d)) {
+		dev_warn(&par->spi->dev, "no debugfs statistics\n");
+		return;
+	}
+	par->debugfs = d;
+
+	debugfs_create_u32("lines", S_IRUGO, d, &st->lines);
+	debugfs_create_u32("skipped", S_IRUGO, d, &st->skipped);
+	debugfs_create_u32("frames", S_IRUGO, d, &st->frames);
+	debugfs_create_u32("converts", S_IRUGO, d, &st->converts);
+	debugfs_create_u64("convert_ns", S_IRUGO, d, &st->convert_ns);
+	debugfs_create_u32("convert_max_us", S_IRUGO, d,
+			   &st->convert_max_us);
+	debugfs_create_file("latency", S_IRUGO, d, par,
+			    &hub12fb_latency_fops);
+}
+
+static void hub12fb_debugfs_exit(struct hub12_par *par)
+{
+	debugfs_remove_recursive(par->debugfs);
+	par->debugfs = NULL;
+}
+
+/* the outputs after the first, on the buses and chip selects of spi_out= */
+static void __devinit hub12fb_add_outputs(struct hub12_par *par)
+{
+	struct spi_board_info out_info = {
+		.modalias	= HUB12_OUT_MODALIAS,
+		.mode		= par->spi->mode,
+		.max_speed_hz	= par->spi->max_speed_hz,
+	};
+	struct spi_master *master;
+	struct spi_device *out;
+	int i;
+
+	for (i=0; i+1<n_spi_out && par->outputs<HUB12_MAX_OUTPUTS; i+=2) {
+		out_info.bus_num = spi_out[i];
+		out_info.chip_select = spi_out[i+1];
+
+		master = spi_busnum_to_master(out_info.bus_num);
+		if (!master) {
+			dev_err(&par->spi->dev, "no spi bus %d for an output\n",
+				out_info.bus_num);
+			continue;
+		}
+		/* no driver binds to it, we only send to it */
+		out = spi_new_device(master, &out_info);
+		spi_master_put(master);
+		if (!out) {
+			dev_err(&par->spi->dev, "spi%d.%d is taken\n",
+				out_info.bus_num, out_info.chip_select);
+			continue;
+		}
+		par->out[par->outputs++] = out;
+	}
+}
+
+static void hub12fb_remove_outputs(struct hub12_par *par)
+{
+	/* output 0 is our own device */
+	while (par->outputs > 1) {
+		par->outputs--;
+		spi_unregister_device(par->out[par->outputs]);
+		par->out[par->outputs] = NULL;
+	}
+}
+
+/* lsb first if every output can, the same mode on all */
+static int __devinit hub12fb_setup_outputs(struct hub12_par *par)
+{
+	int o, retval = 0;
+
+	par->lsb_first = 1;
+	for (o=0; o<par->outputs && par->lsb_first; o++) {
+		par->out[o]->mode |= SPI_LSB_FIRST;
+		if (spi_setup(par->out[o]))
+			par->lsb_first = 0;
+	}
+	if (par->lsb_first)
+		return 0;
+
+	for (o=0; o<par->outputs && !retval; o++) {
+		par->out[o]->mode &= ~SPI_LSB_FIRST;
+		retval = spi_setup(par->out[o]);
+	}
+	return retval;
+}
 
 static int __devinit hub12fb_probe (struct spi_device *spidev)
 {
@@ -960,6 +1734,16 @@ static int __devinit hub12fb_probe (struct spi_device *spidev)
 					GPIOF_OUT_INIT_LOW, DRIVER_NAME "_b");
 	if (retval) goto probe_fail_free_fb;
 
+	par->out[0] = spidev;
+	par->outputs = 1;
+	hub12fb_add_outputs(par);
+
+	/* lsb first masters save reversing the bits of every byte */
+	retval = hub12fb_setup_outputs(par);
+	if (retval) goto probe_fail_free_outputs;
+	dev_info(device, "%d output%s, %s first spi\n", par->outputs,
+		 par->outputs > 1 ? "s" : "", par->lsb_first ? "lsb" : "msb");
+
 	/* register the backlight before we register the framebuffer. */
 	init_hub12bl(info);
 
@@ -977,6 +1761,11 @@ static int __devinit hub12fb_probe (struct spi_device *spidev)
 	hrtimer_init(&par->ledon_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 	par->ledon_timer.function = ledon_expired;
 
+	INIT_WORK(&par->convert_work, convert_worker);
+	INIT_DELAYED_WORK(&par->adapt_work, hub12fb_adapt_worker);
+	par->adaptive = adaptive;
+	spin_lock_init(&par->dirty_lock);
+
 
 	/* some filling in of fb_var_screeninfo */
 	var->xres 	= par->pdata.width;
@@ -1003,6 +1792,16 @@ static int __devinit hub12fb_probe (struct spi_device *spidev)
 	info->flags = FBINFO_FLAG_DEFAULT;
 	info->pseudo_palette = par->pseudo_palette; /* not used */
 
+	/* mmap writes come back to us as dirty pages */
+	par->defio.delay = HZ / 20;
+	par->defio.deferred_io = hub12fb_deferred_io;
+	info->fbdefio = &par->defio;
+	fb_deferred_io_init(info);
+
+	/* which set its own fb_mmap, ours goes in front of it */
+	par->defio_mmap = info->fbops->fb_mmap;
+	info->fbops->fb_mmap = hub12fb_mmap;
+
 	/* calls check_var and set_par */
 	retval = fb_set_var(info, &info->var);
 	if (retval)
@@ -1021,18 +1820,28 @@ static int __devinit hub12fb_probe (struct spi_device *spidev)
 	*/
 
 	spi_set_drvdata(spidev, info);
+	hub12fb_debugfs_init(par);
+
+	/* the refresh can still adapt without them */
+	if (sysfs_create_group(&device->kobj, &hub12fb_attr_group))
+		dev_warn(device, "no sysfs refresh attributes\n");
 
 	return retval;
 
 probe_fail_free_buffers:
-	hub12fb_free_buffers(par);
-
 probe_fail_free_cmap:
 	/* fb_dealloc_cmap(&info->cmap);*/
+	/* it clears the mapping of the pages, so before they go.
+	 * set_par may have allocated them even if fb_set_var failed */
+	hub12fb_defio_cleanup(info);
+	hub12fb_free_buffers(par);
 
 /*probe_fail_free_bl: */
 	exit_hub12bl(info);
 
+probe_fail_free_outputs:
+	hub12fb_remove_outputs(par);
+
 probe_fail_free_fb:
 	framebuffer_release(info);
 
@@ -1048,12 +1857,16 @@ static int __devexit hub12fb_remove(struct spi_device *spidev)
 	struct fb_info *info = spi_get_drvdata(spidev);
 
 	if (info) {
+		sysfs_remove_group(&spidev->dev.kobj, &hub12fb_attr_group);
 		hub12fb_stop_running(info->par);
+		hub12fb_debugfs_exit(info->par);
 		unregister_framebuffer(info);
+		hub12fb_defio_cleanup(info);
 		spi_set_drvdata(spidev, NULL);
 		/*fb_dealloc_cmap(&info->cmap);*/
 		exit_hub12bl(info);
 		hub12fb_free_buffers(info->par);
+		hub12fb_remove_outputs(info->par);
 		/* free gpio ? */
 		framebuffer_release(info);
 	}
@@ -1289,6 +2102,14 @@ module_param_array(spi, int, NULL, 0);
 MODULE_PARM_DESC(spi,
 	" dynamically bind to SPI with spi=<bus>,<cs>,<maxspeed>");
 
+module_param(adaptive, bool, 0);
+MODULE_PARM_DESC(adaptive,
+	" lower the refresh when the spi master falls behind (default 1)");
+
+module_param_array(spi_out, int, &n_spi_out, 0);
+MODULE_PARM_DESC(spi_out,
+	" more outputs for a long wall, spi_out=<bus>,<cs>[,<bus>,<cs>...]");
+
 module_param_array(gpio, int, NULL, 0);
 MODULE_PARM_DESC(gpio,
 		 " specifiy GPIO connections as gpio=<oe>,<la>,<a>,<b>");
@@ -0,0 +1,199 @@
+/*
+ * hub12fb_interlace.h -- framebuffer to wire order for hub12fb.c
+ *
+ * apart from the driver so host/interlace_bench.c can build the same
+ * loaders in userspace (with host/shim/hub12_shim.h standing in for
+ * the kernel types) and check and time them against each other.
+ *
+ * Copyright (C) 2013 Darren Garnier <dgarnier@reinrag.net>
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#ifndef HUB12FB_INTERLACE_H
+#define HUB12FB_INTERLACE_H
+
+/*
+ * def bitreverse(x):
+ *     x = ((x & 0xaa)>>1) | ((x & 0x55)<<1)
+ *     x = ((x & 0xcc)>>2) | ((x & 0x33)<<2)
+ *     x = ((x & 0xf0)>>4) | ((x & 0x0f)<<4)
+ *     return x
+ */
+
+static const unsigned char bit_reverse_inverse[] = {
+	0xff, 0x7f, 0xbf, 0x3f, 0xdf, 0x5f, 0x9f, 0x1f,
+	0xef, 0x6f, 0xaf, 0x2f, 0xcf, 0x4f, 0x8f, 0x0f,
+	0xf7, 0x77, 0xb7, 0x37, 0xd7, 0x57, 0x97, 0x17,
+	0xe7, 0x67, 0xa7, 0x27, 0xc7, 0x47, 0x87, 0x07,
+	0xfb, 0x7b, 0xbb, 0x3b, 0xdb, 0x5b, 0x9b, 0x1b,
+	0xeb, 0x6b, 0xab, 0x2b, 0xcb, 0x4b, 0x8b, 0x0b,
+	0xf3, 0x73, 0xb3, 0x33, 0xd3, 0x53, 0x93, 0x13,
+	0xe3, 0x63, 0xa3, 0x23, 0xc3, 0x43, 0x83, 0x03,
+	0xfd, 0x7d, 0xbd, 0x3d, 0xdd, 0x5d, 0x9d, 0x1d,
+	0xed, 0x6d, 0xad, 0x2d, 0xcd, 0x4d, 0x8d, 0x0d,
+	0xf5, 0x75, 0xb5, 0x35, 0xd5, 0x55, 0x95, 0x15,
+	0xe5, 0x65, 0xa5, 0x25, 0xc5, 0x45, 0x85, 0x05,
+	0xf9, 0x79, 0xb9, 0x39, 0xd9, 0x59, 0x99, 0x19,
+	0xe9, 0x69, 0xa9, 0x29, 0xc9, 0x49, 0x89, 0x09,
+	0xf1, 0x71, 0xb1, 0x31, 0xd1, 0x51, 0x91, 0x11,
+	0xe1, 0x61, 0xa1, 0x21, 0xc1, 0x41, 0x81, 0x01,
+	0xfe, 0x7e, 0xbe, 0x3e, 0xde, 0x5e, 0x9e, 0x1e,
+	0xee, 0x6e, 0xae, 0x2e, 0xce, 0x4e, 0x8e, 0x0e,
+	0xf6, 0x76, 0xb6, 0x36, 0xd6, 0x56, 0x96, 0x16,
+	0xe6, 0x66, 0xa6, 0x26, 0xc6, 0x46, 0x86, 0x06,
+	0xfa, 0x7a, 0xba, 0x3a, 0xda, 0x5a, 0x9a, 0x1a,
+	0xea, 0x6a, 0xaa, 0x2a, 0xca, 0x4a, 0x8a, 0x0a,
+	0xf2, 0x72, 0xb2, 0x32, 0xd2, 0x52, 0x92, 0x12,
+	0xe2, 0x62, 0xa2, 0x22, 0xc2, 0x42, 0x82, 0x02,
+	0xfc, 0x7c, 0xbc, 0x3c, 0xdc, 0x5c, 0x9c, 0x1c,
+	0xec, 0x6c, 0xac, 0x2c, 0xcc, 0x4c, 0x8c, 0x0c,
+	0xf4, 0x74, 0xb4, 0x34, 0xd4, 0x54, 0x94, 0x14,
+	0xe4, 0x64, 0xa4, 0x24, 0xc4, 0x44, 0x84, 0x04,
+	0xf8, 0x78, 0xb8, 0x38, 0xd8, 0x58, 0x98, 0x18,
+	0xe8, 0x68, 0xa8, 0x28, 0xc8, 0x48, 0x88, 0x08,
+	0xf0, 0x70, 0xb0, 0x30, 0xd0, 0x50, 0x90, 0x10,
+	0xe0, 0x60, 0xa0, 0x20, 0xc0, 0x40, 0x80, 0x00
+};
+
+/*
+ * convert_rows breaks up the framebuffer into the
+ * to data that will go over the wire to the shift registers.
+ * individual displays are 32 w x 16 h with 4 scan lines, in 4 colums.
+ *
+ * many things to iterate over...
+ *  i, 4 "scan lines"
+ *  j, height / 16 "module rows"
+ *  k, width / 8 "columes per row"
+ *  l, 4 lines per column (per scanline, bottom up!)
+ *
+ * only the module rows j0 to j1 (exclusive) are converted, the ones the
+ * dirty rows fall in.  each is rowbytes * 4 bytes of every scan line.
+ */
+
+/* the bit reversal is for msb first spi masters.  with one that
+ * shifts lsb first (reverse false) the bytes only need inverting.
+ */
+
+#define CONVERT(byte)	bit_reverse_inverse[byte]
+
+/* the reference, a byte at a time through the table */
+static void inline load_interlace_1bit_table(u8 *lb, u8 *fb, u8 lace,
+					     u16 width, u16 j0, u16 j1,
+					     bool reverse)
+{
+	int j, k, l, rowbytes = width/8;
+	/*
+	* iterates in direction of output stream...
+	* copy the data, 8 pixel byte by byte, need bitswap for SPI
+	* (lsb first spi driver is rare)
+	*/
+
+	lb += j0 * rowbytes * 4;
+	for (j=j0; j<j1; j++)
+		for (k=0; k<rowbytes; k++)
+			for (l=3; l>=0; l--) {
+				u8 byte = fb[rowbytes*(j*16+l*4+lace) + k];
+
+				*lb++ = reverse ? CONVERT(byte) : (u8)~byte;
+			}
+}
+
+/* every byte of a word bit reversed, in place */
+static inline u32 bit_reverse_bytes(u32 x)
+{
+#if defined(__arm__) && (defined(__ARM_ARCH_6T2__) || __ARM_ARCH >= 7)
+	/* reverses the whole word, rev puts the bytes back */
+	asm("rbit %0, %1" : "=r" (x) : "r" (x));
+	return swab32(x);
+#else
+	x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+	x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+	return ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+#endif
+}
+
+/*
+ * the same bytes as the table version, four columns at a time.  a
+ * word from each of the four rows that go out together (l = 3..0) is
+ * inverted (and bit reversed) as a whole, then the 4x4 bytes are
+ * transposed so each output word is one column of the four rows.
+ * the rows are read straight through, the output written straight
+ * through.  rowbytes is a multiple of 4 (width of 32 pixel modules),
+ * the buffers are page or dma aligned, so every access is an aligned
+ * word.
+ */
+static void inline load_interlace_1bit(u8 *lb, u8 *fb, u8 lace,
+					u16 width, u16 j0, u16 j1,
+					bool reverse)
+{
+	int j, k, rowbytes = width/8;
+	const __le32 *r3, *r2, *r1, *r0;
+	__le32 *out = (__le32 *)(lb + j0 * rowbytes * 4);
+	u32 a, b, c, d, t0, t1, t2, t3;
+
+	for (j=j0; j<j1; j++) {
+		r3 = (const __le32 *)(fb + rowbytes*(j*16+12+lace));
+		r2 = (const __le32 *)(fb + rowbytes*(j*16+8+lace));
+		r1 = (const __le32 *)(fb + rowbytes*(j*16+4+lace));
+		r0 = (const __le32 *)(fb + rowbytes*(j*16+lace));
+
+		for (k=0; k<rowbytes/4; k++) {
+			a = ~le32_to_cpu(*r3++);
+			b = ~le32_to_cpu(*r2++);
+			c = ~le32_to_cpu(*r1++);
+			d = ~le32_to_cpu(*r0++);
+			if (reverse) {
+				a = bit_reverse_bytes(a);
+				b = bit_reverse_bytes(b);
+				c = bit_reverse_bytes(c);
+				d = bit_reverse_bytes(d);
+			}
+
+			/* a0 b0 a2 b2, a1 b1 a3 b3, then the same of c d */
+			t0 = (a & 0x00ff00ff) | ((b << 8) & 0xff00ff00);
+			t1 = ((a >> 8) & 0x00ff00ff) | (b & 0xff00ff00);
+			t2 = (c & 0x00ff00ff) | ((d << 8) & 0xff00ff00);
+			t3 = ((c >> 8) & 0x00ff00ff) | (d & 0xff00ff00);
+
+			*out++ = cpu_to_le32((t0 & 0xffff) | (t2 << 16));
+			*out++ = cpu_to_le32((t1 & 0xffff) | (t3 << 16));
+			*out++ = cpu_to_le32((t0 >> 16) | (t2 & 0xffff0000));
+			*out++ = cpu_to_le32((t1 >> 16) | (t3 & 0xffff0000));
+		}
+	}
+}
+
+/*
+ * same loop as 1 bit, but build each byte from 8 pixels through a map,
+ * pixel value to output bit (1 is dark): a palette threshold for the
+ * pseudo color mode, a bit of the level for a grayscale plane.  the
+ * first pixel goes out first, at bit 7 for msb first (reverse).
+ */
+static void inline load_interlace_8bit(u8 *lb, u8 *fb, u8 lace,
+				       u16 width, u16 j0, u16 j1,
+				       const u8 *map, bool reverse)
+{
+	int j, k, l, b, rowbytes= width/8;
+	u8 *px;
+	u8 byte;
+
+	lb += j0 * rowbytes * 4;
+	for (j=j0; j<j1; j++)
+		for (k=0; k<rowbytes; k++)
+			for (l=3; l>=0; l--) {
+				px = fb + width * (j*16+l*4+lace) + k*8;
+				byte = 0;
+				if (reverse)
+					for (b=7; b>=0; b--)
+						byte |= map[*px++] << b;
+				else
+					for (b=0; b<8; b++)
+						byte |= map[*px++] << b;
+				*lb++ = byte;
+			}
+}
+
+#endif /* HUB12FB_INTERLACE_H */
@@ -0,0 +1,94 @@
+/*
+ * hub12fb_trace.h -- tracepoints of the hub12fb scan line, for perf and
+ * trace-cmd (events hub12fb:*).
+ *
+ * a line is started at its hsync, done when the last output finished
+ * shifting it, or skipped when the one before was still going.
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License. See the file COPYING in the main directory of this archive for
+ *  more details.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM hub12fb
+
+#if !defined(_HUB12FB_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _HUB12FB_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(hub12fb_hsync_start,
+
+	TP_PROTO(int set, int line, int plane),
+
+	TP_ARGS(set, line, plane),
+
+	TP_STRUCT__entry(
+		__field(int,	set)
+		__field(int,	line)
+		__field(int,	plane)
+	),
+
+	TP_fast_assign(
+		__entry->set	= set;
+		__entry->line	= line;
+		__entry->plane	= plane;
+	),
+
+	TP_printk("set=%d line=%d plane=%d",
+		  __entry->set, __entry->line, __entry->plane)
+);
+
+TRACE_EVENT(hub12fb_hsync_done,
+
+	TP_PROTO(int line, int plane, u32 latency_us),
+
+	TP_ARGS(line, plane, latency_us),
+
+	TP_STRUCT__entry(
+		__field(int,	line)
+		__field(int,	plane)
+		__field(u32,	latency_us)
+	),
+
+	TP_fast_assign(
+		__entry->line		= line;
+		__entry->plane		= plane;
+		__entry->latency_us	= latency_us;
+	),
+
+	TP_printk("line=%d plane=%d latency=%uus",
+		  __entry->line, __entry->plane, __entry->latency_us)
+);
+
+TRACE_EVENT(hub12fb_hsync_skip,
+
+	TP_PROTO(int line, int plane, u32 skipped),
+
+	TP_ARGS(line, plane, skipped),
+
+	TP_STRUCT__entry(
+		__field(int,	line)
+		__field(int,	plane)
+		__field(u32,	skipped)
+	),
+
+	TP_fast_assign(
+		__entry->line		= line;
+		__entry->plane		= plane;
+		__entry->skipped	= skipped;
+	),
+
+	TP_printk("line=%d plane=%d still shifting, skipped=%u",
+		  __entry->line, __entry->plane, __entry->skipped)
+);
+
+#endif /* _HUB12FB_TRACE_H */
+
+/* this isn't in include/trace, the Makefile adds our directory */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE hub12fb_trace
+#include <trace/define_trace.h>